@@ -44,6 +44,7 @@ void alarm_applet_actions_init(AlarmApplet* applet)
         { "show_alarms_list", alarm_action_toggle_list_win },
         { "autostart", alarm_action_toggle_autostart, NULL, "false" },
         { "show_countdown", alarm_action_toggle_show_label, NULL, "false" },
+        { "import", alarm_action_import, "s" },
     };
     g_action_map_add_action_entries(G_ACTION_MAP(applet->application), app_action_entries, G_N_ELEMENTS(app_action_entries), applet);
 
@@ -83,7 +84,7 @@ void alarm_action_edit(GSimpleAction* action, GVariant* parameter, gpointer data
         return;
     }
 
-    g_debug("AlarmAction: edit '%s'", a->message);
+    g_debug("AlarmAction: edit '%s'", alarm_get_message(a));
 
     // Stop alarm
     alarm_clear(a);
@@ -108,7 +109,7 @@ void alarm_action_delete(GSimpleAction* action, GVariant* parameter, gpointer da
         return;
     }
 
-    g_debug("AlarmAction: delete '%s'", a->message);
+    g_debug("AlarmAction: delete '%s'", alarm_get_message(a));
 
     // Disable, clear and delete alarm
     alarm_disable(a);
@@ -149,9 +150,16 @@ void alarm_action_enable(GSimpleAction* action, GVariant* parameter, gpointer da
         return;
     }
 
-    g_debug("AlarmAction: enabled(%d) '%s'", active, a->message);
+    g_debug("AlarmAction: enabled(%d) '%s'", active, alarm_get_message(a));
+
+    // Running timers are paused rather than stopped, and pick up from there
+    if(a->type == ALARM_TYPE_TIMER && !active)
+        alarm_pause(a);
+    else if(active && alarm_is_paused(a))
+        alarm_resume(a);
+    else
+        alarm_set_enabled(a, active);
 
-    alarm_set_enabled(a, active);
     g_object_unref(a);
 }
 
@@ -193,7 +201,7 @@ void alarm_action_stop(GSimpleAction* action, GVariant* parameter, gpointer data
     Alarm* a;
 
     if((a = alarm_list_window_get_selected_alarm(list_window))) {
-        g_debug("AlarmAction: stop '%s'", a->message);
+        g_debug("AlarmAction: stop '%s'", alarm_get_message(a));
 
         alarm_clear(a);
         g_object_unref(a);
@@ -210,7 +218,7 @@ void alarm_action_snooze(GSimpleAction* action, GVariant* parameter, gpointer da
     Alarm* a;
 
     if((a = alarm_list_window_get_selected_alarm(list_window))) {
-        g_debug("AlarmAction: snooze '%s'", a->message);
+        g_debug("AlarmAction: snooze '%s'", alarm_get_message(a));
 
         alarm_applet_alarm_snooze(applet, a);
         g_object_unref(a);
@@ -237,7 +245,7 @@ void alarm_action_new(GSimpleAction* action, GVariant* parameter, gpointer data)
     g_debug("AlarmAction: new");
 
     // Create new alarm, will fall back to defaults.
-    alarm = alarm_new(applet, applet->settings_global, -1);
+    alarm = alarm_new(applet, alarm_store_gen_id(applet->alarms));
 
     // Set first sound / app in list
     if(applet->sounds != NULL) {
@@ -255,7 +263,7 @@ void alarm_action_new(GSimpleAction* action, GVariant* parameter, gpointer data)
     alarm_applet_alarms_add(applet, alarm);
 
     // Select the new alarm in the list
-    if(alarm_list_window_find_alarm(GTK_TREE_MODEL(list_window->model), alarm, &iter)) {
+    if(alarm_list_window_find_alarm(list_window, alarm, &iter)) {
         selection = gtk_tree_view_get_selection(list_window->tree_view);
         gtk_tree_selection_select_iter(selection, &iter);
     }
@@ -290,6 +298,23 @@ void alarm_action_snooze_all(GSimpleAction* action, GVariant* parameter, gpointe
     alarm_applet_alarms_snooze(applet);
 }
 
+/**
+ * Import alarms action, takes the path of a key file
+ */
+void alarm_action_import(GSimpleAction* action, GVariant* parameter, gpointer data)
+{
+    AlarmApplet* applet = (AlarmApplet*)data;
+    const gchar* filename = g_variant_get_string(parameter, NULL);
+    GError* error = NULL;
+
+    g_debug("AlarmAction: import '%s'", filename);
+
+    if(alarm_applet_alarms_import(applet, filename, &error) < 0) {
+        g_warning("AlarmAction: import failed: %s", error->message);
+        g_error_free(error);
+    }
+}
+
 /**
  * Toggle list window action
  */
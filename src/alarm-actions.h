@@ -33,6 +33,8 @@ void alarm_action_snooze(GSimpleAction* action, GVariant* parameter, gpointer da
 
 void alarm_action_snooze_all(GSimpleAction* action, GVariant* parameter, gpointer data);
 
+void alarm_action_import(GSimpleAction* action, GVariant* parameter, gpointer data);
+
 void alarm_action_toggle_list_win(GSimpleAction* action, GVariant* parameter, gpointer data);
 
 void alarm_action_quit(GSimpleAction* action, GVariant* parameter, gpointer data);
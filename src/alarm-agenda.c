@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-agenda.c -- Alarm occurrences within a time range
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include "alarm-agenda.h"
+
+/*
+ * Every alarm has a cursor at its next occurrence. The cursors are kept
+ * in a binary min-heap, so that the earliest one can be taken and
+ * advanced, which merges the occurrences of all alarms in order.
+ */
+
+typedef struct {
+    Alarm* alarm;
+    gint64 time; // Next occurrence
+} AlarmAgendaCursor;
+
+struct _AlarmAgenda {
+    AlarmAgendaCursor* heap;
+    guint len;
+    gint64 end;
+};
+
+static void alarm_agenda_sift_down(AlarmAgenda* agenda, guint i)
+{
+    AlarmAgendaCursor* heap = agenda->heap;
+    const AlarmAgendaCursor cursor = heap[i];
+
+    for(;;) {
+        guint child = 2 * i + 1;
+        if(child >= agenda->len)
+            break;
+
+        if(child + 1 < agenda->len && heap[child + 1].time < heap[child].time)
+            child++;
+
+        if(cursor.time <= heap[child].time)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = cursor;
+}
+
+/*
+ * Occurrence following the given one, or -1 if there are no more
+ */
+static gint64 alarm_agenda_following(Alarm* alarm, gint64 time)
+{
+    if(!alarm_should_repeat(alarm))
+        return -1;
+
+    return alarm_get_next_occurrence(alarm, time);
+}
+
+AlarmAgenda* alarm_agenda_new(GPtrArray* alarms, gint64 start, gint64 end)
+{
+    AlarmAgenda* agenda = g_new0(AlarmAgenda, 1);
+
+    agenda->heap = g_new(AlarmAgendaCursor, alarms->len);
+    agenda->end = end;
+
+    for(guint i = 0; i < alarms->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(alarms, i));
+        gint64 time = alarm->timestamp;
+
+        if(!alarm->active)
+            continue;
+
+        // Overdue, or the range starts later
+        if(time < start)
+            time = alarm_agenda_following(alarm, start - 1);
+
+        if(time < start || time >= end)
+            continue;
+
+        agenda->heap[agenda->len].alarm = alarm;
+        agenda->heap[agenda->len].time = time;
+        agenda->len++;
+    }
+
+    for(guint i = agenda->len / 2; i > 0; i--)
+        alarm_agenda_sift_down(agenda, i - 1);
+
+    return agenda;
+}
+
+gboolean alarm_agenda_next(AlarmAgenda* agenda, AlarmOccurrence* occurrence)
+{
+    if(agenda->len == 0)
+        return FALSE;
+
+    AlarmAgendaCursor* top = &agenda->heap[0];
+
+    occurrence->alarm = top->alarm;
+    occurrence->time = top->time;
+
+    top->time = alarm_agenda_following(top->alarm, top->time);
+
+    if(top->time < 0 || top->time >= agenda->end) {
+        // Exhausted, replace with the last cursor
+        agenda->heap[0] = agenda->heap[--agenda->len];
+    }
+
+    if(agenda->len > 0)
+        alarm_agenda_sift_down(agenda, 0);
+
+    return TRUE;
+}
+
+void alarm_agenda_free(AlarmAgenda* agenda)
+{
+    g_free(agenda->heap);
+    g_free(agenda);
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-agenda.h -- Alarm occurrences within a time range
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_AGENDA_H_
+#define ALARM_AGENDA_H_
+
+#include <glib.h>
+
+#include "alarm.h"
+
+G_BEGIN_DECLS
+
+typedef struct _AlarmAgenda AlarmAgenda;
+
+typedef struct {
+    Alarm* alarm;
+    gint64 time; /* UNIX timestamp */
+} AlarmOccurrence;
+
+/*
+ * Iterate over the occurrences of the active alarms within [start, end),
+ * in chronological order. Occurrences are expanded as they are needed,
+ * so the range may be large.
+ */
+AlarmAgenda* alarm_agenda_new(GPtrArray* alarms, gint64 start, gint64 end);
+
+gboolean alarm_agenda_next(AlarmAgenda* agenda, AlarmOccurrence* occurrence);
+
+void alarm_agenda_free(AlarmAgenda* agenda);
+
+G_END_DECLS
+
+#endif /*ALARM_AGENDA_H_*/
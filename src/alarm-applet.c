@@ -11,7 +11,10 @@
 #include "alarm-applet.h"
 
 #include "alarm.h"
+#include "alarm-agenda.h"
+#include "alarm-scheduler.h"
 #include "alarm-settings.h"
+#include "alarm-storage.h"
 
 /*
  * DEFINTIIONS {{
@@ -37,20 +40,18 @@ GHashTable* app_command_map = NULL;
  */
 guint alarm_applet_alarms_snooze(AlarmApplet* applet)
 {
-    GList* l;
     Alarm* a;
     guint n_snoozed = 0;
 
     g_debug("Snoozing alarms...");
 
     // Loop through alarms and snooze all triggered ones
-    for(l = applet->alarms; l; l = l->next) {
-        a = ALARM(l->data);
+    for(guint i = alarm_store_next(applet->alarms, ALARM_STORE_TRIGGERED, 0); i < alarm_store_get_size(applet->alarms);
+        i = alarm_store_next(applet->alarms, ALARM_STORE_TRIGGERED, i + 1)) {
+        a = alarm_store_index(applet->alarms, i);
 
-        if(a->triggered) {
-            alarm_applet_alarm_snooze(applet, a);
-            n_snoozed++;
-        }
+        alarm_applet_alarm_snooze(applet, a);
+        n_snoozed++;
     }
 
     // Reset the triggered counter
@@ -67,20 +68,18 @@ guint alarm_applet_alarms_snooze(AlarmApplet* applet)
  */
 guint alarm_applet_alarms_stop(AlarmApplet* applet)
 {
-    GList* l;
     Alarm* a;
     guint n_stopped = 0;
 
     g_debug("Stopping alarms...");
 
     // Loop through alarms and clear all of 'em
-    for(l = applet->alarms; l; l = l->next) {
-        a = ALARM(l->data);
+    for(guint i = alarm_store_next(applet->alarms, ALARM_STORE_TRIGGERED, 0); i < alarm_store_get_size(applet->alarms);
+        i = alarm_store_next(applet->alarms, ALARM_STORE_TRIGGERED, i + 1)) {
+        a = alarm_store_index(applet->alarms, i);
 
-        if(a->triggered) {
-            alarm_clear(a);
-            n_stopped++;
-        }
+        alarm_clear(a);
+        n_stopped++;
     }
 
     // Reset the triggered counter
@@ -104,7 +103,7 @@ void alarm_applet_alarm_snooze(AlarmApplet* applet, Alarm* alarm)
         mins = ALARM_STD_SNOOZE;
     }
 
-    g_debug("AlarmApplet: snooze '%s' for %d minutes", alarm->message, mins);
+    g_debug("AlarmApplet: snooze '%s' for %d minutes", alarm_get_message(alarm), mins);
 
     alarm_snooze(alarm, mins * 60);
 
@@ -132,13 +131,13 @@ void alarm_applet_alarm_stop(AlarmApplet* applet, Alarm* alarm)
  */
 
 // Load sounds into list
-// TODO: Refactor to use a GHashTable with string hash
 void alarm_applet_sounds_load(AlarmApplet* applet)
 {
     Alarm* alarm;
     AlarmListEntry* entry;
-    GList *l, *l2;
-    gboolean found;
+    GList* l2;
+    GList* custom = NULL;
+    GHashTable* found;
 
     const gchar* const* sysdirs;
     gchar* sounds_dir = NULL;
@@ -169,27 +168,38 @@ void alarm_applet_sounds_load(AlarmApplet* applet)
         g_warning("AlarmApplet: Could not locate sounds!");
     }
 
-    // Load custom sounds from alarms
-    for(l = applet->alarms; l != NULL; l = l->next) {
-        alarm = ALARM(l->data);
-        found = FALSE;
-        for(l2 = applet->sounds; l2 != NULL; l2 = l2->next) {
-            entry = (AlarmListEntry*)l2->data;
-            if(strcmp(alarm->sound_file, entry->data) == 0) {
-                // FOUND
-                found = TRUE;
-                break;
-            }
-        }
+    // Sound files in the list so far, interned like those of the alarms so
+    // that they can be compared by pointer
+    found = g_hash_table_new_full(NULL, NULL, (GDestroyNotify)g_ref_string_release, NULL);
 
-        if(!found) {
-            // Add to list
-            entry = alarm_list_entry_new_file(alarm->sound_file, NULL, NULL);
-            if(entry) {
-                applet->sounds = g_list_append(applet->sounds, entry);
-            }
+    for(l2 = applet->sounds; l2 != NULL; l2 = l2->next) {
+        entry = (AlarmListEntry*)l2->data;
+        g_hash_table_add(found, g_ref_string_new_intern(entry->data));
+    }
+
+    // Load custom sounds from alarms. Those whose sound file hasn't been
+    // read yet are added once it is, see alarm_sound_file_changed().
+    for(guint j = 0; j < alarm_store_get_size(applet->alarms); j++) {
+        alarm = alarm_store_index(applet->alarms, j);
+        if(!alarm_is_cold_loaded(alarm))
+            continue;
+
+        gchar* sound_file = (gchar*)alarm_get_sound_file(alarm);
+        if(g_hash_table_contains(found, sound_file))
+            continue;
+
+        g_hash_table_add(found, g_ref_string_acquire(sound_file));
+
+        // Add to list
+        entry = alarm_list_entry_new_file(sound_file, NULL, NULL);
+        if(entry) {
+            custom = g_list_prepend(custom, entry);
         }
     }
+
+    applet->sounds = g_list_concat(applet->sounds, g_list_reverse(custom));
+
+    g_hash_table_destroy(found);
 }
 
 // Notify callback for changes to an alarm's sound_file
@@ -364,39 +374,42 @@ void alarm_applet_apps_load(AlarmApplet* applet)
  * Alarms list {{
  */
 
-// TODO: Refactor to use a GHashTable instead?
 void alarm_applet_alarms_load(AlarmApplet* applet)
 {
-    GList* list = NULL;
-    GList* l = NULL;
+    GPtrArray* list;
 
-    if(applet->alarms != NULL) {
-        // Free old alarm objects
-        for(l = applet->alarms; l != NULL; l = l->next) {
-            g_object_unref(ALARM(l->data));
-        }
-
-        // Free list
-        g_list_free(applet->alarms);
-    }
+    // Free old alarm objects
+    if(applet->alarms != NULL)
+        alarm_store_free(applet->alarms);
 
     // Fetch list of alarms and add them
-    applet->alarms = NULL;
+    applet->alarms = alarm_store_new();
     list = alarm_get_list(applet, applet->settings_global);
 
-    for(l = list; l != NULL; l = l->next) {
-        alarm_applet_alarms_add(applet, ALARM(l->data));
+    for(guint i = 0; i < list->len; i++) {
+        alarm_applet_alarms_add(applet, g_object_ref(ALARM(g_ptr_array_index(list, i))));
     }
+
+    g_ptr_array_free(list, TRUE);
 }
 
+static Alarm* alarm_applet_alarms_lookup(guint id, gpointer data)
+{
+    AlarmApplet* applet = (AlarmApplet*)data;
+
+    return applet->alarms ? alarm_store_lookup(applet->alarms, id) : NULL;
+}
+
+/*
+ * Add an alarm, taking over the caller's reference
+ */
 void alarm_applet_alarms_add(AlarmApplet* applet, Alarm* alarm)
 {
-    applet->alarms = g_list_append(applet->alarms, alarm);
+    alarm_store_add(applet->alarms, alarm);
 
     g_signal_connect(alarm, "notify", G_CALLBACK(alarm_applet_alarm_changed), applet);
     g_signal_connect(alarm, "notify::sound-file", G_CALLBACK(alarm_sound_file_changed), applet);
 
-    g_signal_connect(alarm, "alarm", G_CALLBACK(alarm_applet_alarm_triggered), applet);
     g_signal_connect(alarm, "cleared", G_CALLBACK(alarm_applet_alarm_cleared), applet);
 
     // Update alarm list window model
@@ -417,7 +430,7 @@ void alarm_applet_alarms_remove_and_delete(AlarmApplet* applet, Alarm* alarm)
     alarm_delete(alarm);
 
     // Remove from list
-    applet->alarms = g_list_remove(applet->alarms, alarm);
+    alarm_store_remove(applet->alarms, alarm);
 
     // Clear list store. This will decrease the refcount of our alarms by 1.
     /*if (applet->list_alarms_store)
@@ -428,6 +441,10 @@ void alarm_applet_alarms_remove_and_delete(AlarmApplet* applet, Alarm* alarm)
     // Remove any signal handlers for this alarm instance.
     g_signal_handlers_disconnect_matched(alarm, 0, 0, 0, NULL, NULL, NULL);
 
+    // Drop any pending UI update, it holds no reference
+    if(applet->changed_alarms)
+        g_hash_table_remove(applet->changed_alarms, alarm);
+
     // Update alarm list window model
     if(applet->list_window) {
         alarm_list_window_alarm_remove(applet->list_window, alarm);
@@ -437,6 +454,58 @@ void alarm_applet_alarms_remove_and_delete(AlarmApplet* applet, Alarm* alarm)
     alarm_unref(alarm);
 }
 
+/*
+ * Add the alarms of a key file, one per group, as new alarms. Their
+ * settings are written one transaction per alarm, or into the packed key
+ * with packed storage, and the alarm list once at the end. Groups with
+ * invalid values are skipped.
+ *
+ * Returns the number of alarms imported, or -1 if the file couldn't be read.
+ */
+gint alarm_applet_alarms_import(AlarmApplet* applet, const gchar* filename, GError** error)
+{
+    GKeyFile* keyfile = g_key_file_new();
+    gchar** groups;
+    gint n_imported = 0;
+
+    if(!g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(keyfile);
+        return -1;
+    }
+
+    groups = g_key_file_get_groups(keyfile, NULL);
+
+    if(applet->list_window)
+        alarm_list_window_freeze(applet->list_window);
+
+    for(guint i = 0; groups[i]; i++) {
+        const guint id = alarm_store_gen_id(applet->alarms);
+        GError* err = NULL;
+
+        if(!alarm_import_key_file(id, keyfile, groups[i], &err)) {
+            g_warning("AlarmApplet: import: %s", err->message);
+            g_error_free(err);
+            continue;
+        }
+
+        alarm_applet_alarms_add(applet, alarm_new(applet, id));
+        n_imported++;
+    }
+
+    if(applet->list_window)
+        alarm_list_window_thaw(applet->list_window);
+
+    if(n_imported > 0)
+        alarm_update_gsettings_alarm_list(applet->settings_global, applet->alarms);
+
+    g_debug("AlarmApplet: imported %d alarms from %s", n_imported, filename);
+
+    g_strfreev(groups);
+    g_key_file_free(keyfile);
+
+    return n_imported;
+}
+
 /*
  * }} Alarms list
  */
@@ -519,8 +588,13 @@ void alarm_applet_activate(GtkApplication* app, gpointer user_data)
 
     // Initialize gsettings
     alarm_applet_gsettings_init(applet);
+    alarm_storage_init(applet->settings_global);
+    alarm_storage_set_lookup_func(alarm_applet_alarms_lookup, applet);
 
-    // Load alarms
+    // Load alarms, holding off their timers until the missed ones are
+    // sorted out below
+    alarm_set_triggered_func(alarm_applet_alarms_triggered, applet);
+    alarm_timers_freeze();
     alarm_applet_alarms_load(applet);
 
     // Load sounds from alarms
@@ -532,6 +606,10 @@ void alarm_applet_activate(GtkApplication* app, gpointer user_data)
     // Set up applet UI
     alarm_applet_ui_init(applet);
 
+    // Trigger the alarms that went off while we weren't running
+    alarm_reconcile(applet->alarms);
+    alarm_timers_thaw();
+
     // Show alarms window, unless --hidden
     if(!applet->hidden)
         g_action_activate(G_ACTION(applet->action_toggle_list_win), NULL);
@@ -543,16 +621,111 @@ void alarm_applet_activate(GtkApplication* app, gpointer user_data)
 static void alarm_applet_quit(AlarmApplet* applet)
 {
     g_debug("AlarmApplet: Quitting...");
+
+    // Write the alarms that changed since the last idle
+    alarm_storage_flush();
+}
+
+/**
+ * Print the alarms of the next 24 hours
+ */
+static void alarm_applet_agenda_print(void)
+{
+    GSettings* settings = g_settings_new("io.github.alarm-clock-applet");
+    GPtrArray* alarms;
+    const gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    AlarmAgenda* agenda;
+    AlarmOccurrence occurrence;
+
+    alarm_storage_init(settings);
+    alarms = alarm_get_list_detached(settings);
+    agenda = alarm_agenda_new(alarms, now, now + 24 * 60 * 60);
+
+    while(alarm_agenda_next(agenda, &occurrence)) {
+        GDateTime* dt = g_date_time_new_from_unix_local(occurrence.time);
+        gchar* time = g_date_time_format(dt, "%a %X");
+
+        g_print("%s  %s\n", time, alarm_get_message(occurrence.alarm));
+
+        g_free(time);
+        g_date_time_unref(dt);
+    }
+
+    alarm_agenda_free(agenda);
+    g_ptr_array_free(alarms, TRUE);
+    g_object_unref(settings);
+}
+
+/**
+ * Write all alarms to a key file, in the format read by --import
+ */
+static gboolean alarm_applet_alarms_export(const gchar* filename, GError** error)
+{
+    GSettings* settings = g_settings_new("io.github.alarm-clock-applet");
+    GPtrArray* alarms;
+    GKeyFile* keyfile = g_key_file_new();
+    gboolean ret;
+
+    alarm_storage_init(settings);
+    alarms = alarm_get_list_detached(settings);
+
+    for(guint i = 0; i < alarms->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(alarms, i));
+        gchar* group = g_strdup_printf("Alarm %u", alarm->id);
+
+        alarm_export_key_file(alarm, keyfile, group);
+
+        g_free(group);
+    }
+
+    ret = g_key_file_save_to_file(keyfile, filename, error);
+
+    g_key_file_free(keyfile);
+    g_ptr_array_free(alarms, TRUE);
+    g_object_unref(settings);
+
+    return ret;
 }
 
 static gint handle_local_options(GApplication* application, GVariantDict* options, gpointer user_data)
 {
     guint32 count;
+    const gchar* scheduler;
+    const gchar* filename;
+
     if(g_variant_dict_lookup(options, "version", "b", &count)) {
         g_print(PACKAGE_NAME " " VERSION "\n");
         return 0;
     }
 
+    if(g_variant_dict_lookup(options, "agenda", "b", &count)) {
+        alarm_applet_agenda_print();
+        return 0;
+    }
+
+    if(g_variant_dict_lookup(options, "export", "^&ay", &filename)) {
+        GError* error = NULL;
+
+        if(!alarm_applet_alarms_export(filename, &error)) {
+            g_printerr(_("Could not export alarms: %s\n"), error->message);
+            g_error_free(error);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if(g_variant_dict_lookup(options, "scheduler", "&s", &scheduler)) {
+        AlarmSchedulerBackend backend;
+
+        if(!alarm_scheduler_backend_from_string(scheduler, &backend)) {
+            g_printerr(_("Unknown scheduler: %s\n"), scheduler);
+            return 1;
+        }
+
+        alarm_scheduler_set_default_backend(backend);
+    }
+
     return -1;
 }
 
@@ -561,9 +734,34 @@ static gint handle_command_line(GApplication* application, GApplicationCommandLi
     AlarmApplet* applet = user_data;
     gboolean stop_all = FALSE;
     gboolean snooze_all = FALSE;
+    const gchar* filename = NULL;
 
     GVariantDict* options = g_application_command_line_get_options_dict(cmdline);
 
+    if(g_variant_dict_lookup(options, "import", "^&ay", &filename)) {
+        GFile* file = g_application_command_line_create_file_for_arg(cmdline, filename);
+        gchar* path = g_file_get_path(file);
+        GError* error = NULL;
+        gint n;
+
+        // The alarms have to be loaded first
+        if(!applet->alarms)
+            g_application_activate(G_APPLICATION(application));
+
+        n = alarm_applet_alarms_import(applet, path, &error);
+        if(n < 0) {
+            g_application_command_line_printerr(cmdline, _("Could not import alarms: %s\n"), error->message);
+            g_error_free(error);
+        } else {
+            g_application_command_line_print(cmdline, ngettext("Imported %d alarm\n", "Imported %d alarms\n", n), n);
+        }
+
+        g_free(path);
+        g_object_unref(file);
+
+        return n < 0 ? 1 : 0;
+    }
+
     if(g_variant_dict_lookup(options, "stop-all", "b", &stop_all))
         g_action_activate(G_ACTION(applet->action_stop_all), NULL);
 
@@ -608,6 +806,10 @@ int main(int argc, char* argv[])
         { "stop-all", 's', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, NULL, _("Stop all alarms"), NULL },
         { "snooze-all", 'z', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, NULL, _("Snooze all alarms"), NULL },
         { "version", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, NULL, _("Display version information"), NULL },
+        { "agenda", 'a', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, NULL, _("List the alarms of the next 24 hours"), NULL },
+        { "scheduler", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, NULL, _("Alarm scheduler to use (heap, wheel)"), _("NAME") },
+        { "import", 'i', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, NULL, _("Add the alarms of a file"), _("FILE") },
+        { "export", 'e', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, NULL, _("Save all alarms to a file"), _("FILE") },
         { NULL }
     };
     g_application_add_main_option_entries(G_APPLICATION(application), entries);
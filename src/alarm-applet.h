@@ -33,6 +33,7 @@ void alarm_applet_label_update(AlarmApplet* applet);
 void alarm_applet_clear_alarms(AlarmApplet* applet);
 
 #include "alarm.h"
+#include "alarm-store.h"
 #include "prefs.h"
 #include "alarm-gsettings.h"
 #include "player.h"
@@ -71,9 +72,14 @@ struct _AlarmApplet {
     GtkWidget* status_menu;
 
     /* Alarms */
-    GList* alarms;
+    AlarmStore* alarms;
     guint n_triggered; // Number of triggered alarms
 
+    /* Alarms changed since the last UI update, see alarm_applet_alarm_changed() */
+    GHashTable* changed_alarms;
+    gboolean changed_active; // The active property of one of them changed
+    guint changed_id;        // Idle source of the pending UI update
+
     /* Sounds & apps list */
     GList* sounds;
     GList* apps;
@@ -120,6 +126,8 @@ void alarm_applet_alarms_add(AlarmApplet* applet, Alarm* alarm);
 
 void alarm_applet_alarms_remove_and_delete(AlarmApplet* applet, Alarm* alarm);
 
+gint alarm_applet_alarms_import(AlarmApplet* applet, const gchar* filename, GError** error);
+
 guint alarm_applet_alarms_snooze(AlarmApplet* applet);
 
 guint alarm_applet_alarms_stop(AlarmApplet* applet);
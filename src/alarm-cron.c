@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-cron.c -- Cron expression recurrence
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alarm-cron.h"
+#include "alarm-timezone.h"
+
+#define MINUTES_PER_DAY (24 * 60)
+
+/* Give up on expressions that never match, such as February 30th */
+#define ALARM_CRON_MAX_DAYS (5 * 366)
+
+static const gchar* const alarm_cron_month_names[] = { "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec", NULL };
+static const gchar* const alarm_cron_wday_names[] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat", NULL };
+
+static const struct {
+    const gchar* name;
+    const gchar* expr;
+} alarm_cron_shorthands[] = {
+    { "@yearly",   "0 0 1 1 *" },
+    { "@annually", "0 0 1 1 *" },
+    { "@monthly",  "0 0 1 * *" },
+    { "@weekly",   "0 0 * * 0" },
+    { "@daily",    "0 0 * * *" },
+    { "@midnight", "0 0 * * *" },
+    { "@hourly",   "0 * * * *" },
+};
+
+static inline guint alarm_cron_ctz(guint64 bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    guint n = 0;
+
+    while(!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+/*
+ * Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+ */
+static gint64 alarm_cron_days_from_civil(gint64 y, guint m, guint d)
+{
+    y -= m <= 2;
+
+    const gint64 era = (y >= 0 ? y : y - 399) / 400;
+    const guint yoe = y - era * 400;
+    const guint doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const guint doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+static void alarm_cron_civil_from_days(gint64 days, gint64* y, guint* m, guint* d)
+{
+    days += 719468;
+
+    const gint64 era = (days >= 0 ? days : days - 146096) / 146097;
+    const guint doe = days - era * 146097;
+    const guint yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const guint doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const guint mp = (5 * doy + 2) / 153;
+
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+/*
+ * Parse a number up to max, or a name standing for first + its index
+ */
+static gboolean alarm_cron_parse_value(const gchar* str, const gchar* const* names, guint first, guint max, guint* value)
+{
+    gchar* end;
+    guint64 number;
+
+    if(names) {
+        for(guint i = 0; names[i]; i++) {
+            if(g_ascii_strcasecmp(str, names[i]) == 0) {
+                *value = first + i;
+                return TRUE;
+            }
+        }
+    }
+
+    // Also rejects the empty ends of ranges like "1-", and signs
+    if(!g_ascii_isdigit(*str))
+        return FALSE;
+
+    errno = 0;
+    number = g_ascii_strtoull(str, &end, 10);
+
+    if(errno == ERANGE || *end != '\0' || number > max)
+        return FALSE;
+
+    *value = number;
+
+    return TRUE;
+}
+
+/*
+ * Parse one comma separated field into a bitset of the values within [min, max]
+ */
+static gboolean alarm_cron_parse_field(const gchar* field, guint min, guint max, const gchar* const* names, guint64* bits, gboolean* any)
+{
+    gchar** parts = g_strsplit(field, ",", -1);
+    gboolean ret = TRUE;
+
+    *bits = 0;
+    // Like cron, */2 still leaves the day unrestricted for choosing
+    // whether the day of the month or of the week has to match
+    *any = field[0] == '*';
+
+    for(guint i = 0; ret && parts[i]; i++) {
+        gchar* part = parts[i];
+        gchar* slash = strchr(part, '/');
+        gchar* dash;
+        guint lo, hi, step = 1;
+
+        if(slash) {
+            *slash = '\0';
+            ret = alarm_cron_parse_value(slash + 1, NULL, 0, max, &step) && step > 0;
+        }
+
+        dash = strchr(part, '-');
+        if(dash)
+            *dash = '\0';
+
+        if(g_strcmp0(part, "*") == 0) {
+            lo = min;
+            hi = max;
+        } else if(alarm_cron_parse_value(part, names, min, max, &lo)) {
+            // A single value with a step runs to the end of the range
+            if(dash)
+                ret = ret && alarm_cron_parse_value(dash + 1, names, min, max, &hi);
+            else
+                hi = slash ? max : lo;
+        } else {
+            ret = FALSE;
+        }
+
+        if(!ret || lo < min || hi > max || lo > hi) {
+            ret = FALSE;
+            break;
+        }
+
+        for(guint v = lo; v <= hi; v += step)
+            *bits |= G_GUINT64_CONSTANT(1) << v;
+    }
+
+    g_strfreev(parts);
+
+    return ret;
+}
+
+gboolean alarm_cron_parse(const gchar* expr, AlarmCron* cron)
+{
+    gchar** fields;
+    guint64 bits[5];
+    gboolean any, ret;
+
+    memset(cron, 0, sizeof(*cron));
+
+    for(guint i = 0; i < G_N_ELEMENTS(alarm_cron_shorthands); i++) {
+        if(g_ascii_strcasecmp(expr, alarm_cron_shorthands[i].name) == 0) {
+            expr = alarm_cron_shorthands[i].expr;
+            break;
+        }
+    }
+
+    fields = g_strsplit_set(expr, " \t", -1);
+
+    // Drop the empty fields between repeated spaces
+    guint n = 0;
+    for(guint i = 0; fields[i]; i++) {
+        if(*fields[i])
+            fields[n++] = fields[i];
+        else
+            g_free(fields[i]);
+    }
+    fields[n] = NULL;
+
+    ret = n == 5;
+    ret = ret && alarm_cron_parse_field(fields[0], 0, 59, NULL, &bits[0], &any);
+    ret = ret && alarm_cron_parse_field(fields[1], 0, 23, NULL, &bits[1], &any);
+    ret = ret && alarm_cron_parse_field(fields[2], 1, 31, NULL, &bits[2], &cron->mday_any);
+    ret = ret && alarm_cron_parse_field(fields[3], 1, 12, alarm_cron_month_names, &bits[3], &any);
+    // Sunday is both 0 and 7
+    ret = ret && alarm_cron_parse_field(fields[4], 0, 7, alarm_cron_wday_names, &bits[4], &cron->wday_any);
+
+    g_strfreev(fields);
+
+    if(!ret)
+        return FALSE;
+
+    cron->minutes = bits[0];
+    cron->hours = bits[1];
+    cron->mdays = bits[2];
+    cron->months = bits[3];
+    cron->wdays = (bits[4] | bits[4] >> 7) & 0x7f;
+
+    return TRUE;
+}
+
+/*
+ * Days from the given one to the end of its month that match, as a bitset
+ * where bit 0 is the given day. wday is its day of the week.
+ */
+static guint64 alarm_cron_days_matching(const AlarmCron* cron, guint mday, guint wday, guint days_in_month)
+{
+    const guint64 mask = (G_GUINT64_CONSTANT(1) << (days_in_month - mday + 1)) - 1;
+    const guint64 mdays = (cron->mdays >> mday) & mask;
+    // Starting from wday, repeated for every week left
+    guint64 wdays = ((cron->wdays >> wday) | (cron->wdays << (7 - wday))) & 0x7f;
+
+    wdays |= wdays << 7;
+    wdays |= wdays << 14;
+    wdays |= wdays << 28;
+    wdays &= mask;
+
+    if(cron->mday_any || cron->wday_any)
+        return mdays & wdays;
+
+    return mdays | wdays;
+}
+
+gint64 alarm_cron_next(const AlarmCron* cron, gint64 after)
+{
+    // Minutes since the epoch, in local time
+    gint64 minute = alarm_timezone_to_local(after) / 60 + 1;
+    const gint64 limit = minute + (gint64)ALARM_CRON_MAX_DAYS * MINUTES_PER_DAY;
+
+    while(minute < limit) {
+        const gint64 day = minute / MINUTES_PER_DAY;
+        const guint hour = minute % MINUTES_PER_DAY / 60;
+        const guint min = minute % 60;
+        gint64 y;
+        guint m, d;
+        guint64 bits;
+
+        alarm_cron_civil_from_days(day, &y, &m, &d);
+
+        if(!((cron->months >> m) & 1)) {
+            // The first day of the next matching month
+            bits = cron->months & ~((2u << m) - 1);
+            if(bits)
+                minute = alarm_cron_days_from_civil(y, alarm_cron_ctz(bits), 1) * MINUTES_PER_DAY;
+            else
+                minute = alarm_cron_days_from_civil(y + 1, alarm_cron_ctz(cron->months), 1) * MINUTES_PER_DAY;
+            continue;
+        }
+
+        // The nearest matching day of this month, 1970-01-01 was a Thursday
+        const gint64 next_month = m == 12 ? alarm_cron_days_from_civil(y + 1, 1, 1) : alarm_cron_days_from_civil(y, m + 1, 1);
+        bits = alarm_cron_days_matching(cron, d, (day % 7 + 7 + 4) % 7, next_month - day + d - 1);
+
+        if(!bits) {
+            minute = next_month * MINUTES_PER_DAY;
+            continue;
+        }
+
+        if(!(bits & 1)) {
+            minute = (day + alarm_cron_ctz(bits)) * MINUTES_PER_DAY;
+            continue;
+        }
+
+        if(!((cron->hours >> hour) & 1)) {
+            bits = cron->hours & ~((2u << hour) - 1);
+            if(bits)
+                minute = day * MINUTES_PER_DAY + alarm_cron_ctz(bits) * 60;
+            else
+                minute = (day + 1) * MINUTES_PER_DAY;
+            continue;
+        }
+
+        bits = cron->minutes & ~((G_GUINT64_CONSTANT(1) << min) - 1);
+        if(!bits) {
+            minute = day * MINUTES_PER_DAY + (hour + 1) * 60;
+            continue;
+        }
+
+        minute = day * MINUTES_PER_DAY + hour * 60 + alarm_cron_ctz(bits);
+
+        // A repeated local time may resolve to before where we started
+        const gint64 ret = alarm_timezone_from_local(minute * 60);
+        if(ret > after)
+            return ret;
+
+        minute++;
+    }
+
+    return -1;
+}
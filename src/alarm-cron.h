@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-cron.h -- Cron expression recurrence
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_CRON_H_
+#define ALARM_CRON_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A compiled cron expression. Each field is a bitset of the values it
+ * matches.
+ */
+typedef struct {
+    guint64 minutes; /* Bits 0-59 */
+    guint32 hours;   /* Bits 0-23 */
+    guint32 mdays;   /* Bits 1-31 */
+    guint16 months;  /* Bits 1-12 */
+    guint8 wdays;    /* Bits 0-6, 0 is Sunday */
+
+    /* Day of month and day of week match either one, unless one is '*' */
+    gboolean mday_any;
+    gboolean wday_any;
+} AlarmCron;
+
+/*
+ * Compile a standard five field expression ("minute hour day-of-month
+ * month day-of-week"). Lists, ranges, steps, month and day names, and
+ * the @hourly, @daily, @weekly, @monthly and @yearly shorthands are
+ * supported.
+ */
+gboolean alarm_cron_parse(const gchar* expr, AlarmCron* cron);
+
+/*
+ * First matching minute after the given UNIX timestamp, in local time,
+ * or -1 if there is none within the next few years.
+ */
+gint64 alarm_cron_next(const AlarmCron* cron, gint64 after);
+
+G_END_DECLS
+
+#endif /*ALARM_CRON_H_*/
@@ -27,3 +27,14 @@ typedef enum {
     ALARM_NOTIFY_SOUND,   /* Notification by sound */
     ALARM_NOTIFY_COMMAND, /* Notification by command */
 } AlarmNotifyType;
+
+typedef enum {
+    ALARM_CATCH_UP_SKIP = 0, /* Missed occurrences are dropped */
+    ALARM_CATCH_UP_ONCE,     /* Missed occurrences trigger once */
+    ALARM_CATCH_UP_ALL,      /* Every missed occurrence triggers */
+} AlarmCatchUp;
+
+typedef enum {
+    ALARM_STORAGE_PATHS = 0, /* A settings path per alarm */
+    ALARM_STORAGE_PACKED,    /* All alarms in one key */
+} AlarmStorage;
@@ -6,6 +6,8 @@
  * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "alarm-applet.h"
@@ -13,27 +15,35 @@
 #include "alarm-settings.h"
 #include "alarm.h"
 
-static inline gboolean alarm_in_alarm_list(guint32 id, GList* alarms)
+static gint alarm_id_compare(gconstpointer a, gconstpointer b)
 {
-    for(GList* l = alarms; l; l = l->next) {
-        if(id == ALARM(l->data)->id)
-            return TRUE;
-    }
-    return FALSE;
+    const guint32 id1 = *(const guint32*)a;
+    const guint32 id2 = *(const guint32*)b;
+
+    return (id1 > id2) - (id1 < id2);
 }
 
-static inline gboolean alarm_in_gsettings_list(guint32 id, const guint32* values, gsize count)
+/*
+ * Sort ids and drop duplicates, returning the new count
+ */
+static gsize alarm_ids_sort(guint32* ids, gsize count)
 {
-    for(guint32 i = 0; i < count; i++) {
-        if(values[i] == id)
-            return TRUE;
+    gsize n = 0;
+
+    qsort(ids, count, sizeof(guint32), alarm_id_compare);
+
+    for(gsize i = 0; i < count; i++) {
+        if(n == 0 || ids[n - 1] != ids[i])
+            ids[n++] = ids[i];
     }
-    return FALSE;
+
+    return n;
 }
 
 void alarm_list_changed(GSettings* self, gchar* key, gpointer user_data)
 {
     AlarmApplet* applet = user_data;
+    AlarmStore* store = applet->alarms;
     g_debug("alarm_list_changed");
 
     // Get new list of alarms
@@ -41,24 +51,46 @@ void alarm_list_changed(GSettings* self, gchar* key, gpointer user_data)
     gsize count = 0;
     const guint32* values = g_variant_get_fixed_array(var, &count, sizeof(guint32));
 
-    // First, check if any new alarms have been added
-    for(guint32 i = 0; i < count; i++) {
-        const guint32 settings_id = values[i];
-        // Add the alarm if it doesn't exist
-        if(!alarm_in_alarm_list(settings_id, applet->alarms)) {
-            Alarm* a = alarm_new(applet, self, settings_id);
+    // Sort the new and the current ids, so they can be merged
+    guint32* new_ids = g_new(guint32, count);
+    memcpy(new_ids, values, count * sizeof(guint32));
+    count = alarm_ids_sort(new_ids, count);
 
-            g_debug("\tADD alarm #%d %p", settings_id, a);
+    gsize n_old = alarm_store_get_size(store);
+    guint32* old_ids = g_new(guint32, n_old);
+    for(gsize i = 0; i < n_old; i++)
+        old_ids[i] = alarm_store_index(store, i)->id;
+    n_old = alarm_ids_sort(old_ids, n_old);
 
-            alarm_applet_alarms_add(applet, a);
+    g_variant_unref(var);
+
+    // Ids only in the new list are added, ids only in the old one removed
+    GArray* added = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GPtrArray* removed = g_ptr_array_new();
+    gsize i = 0, j = 0;
+
+    while(i < count || j < n_old) {
+        if(j == n_old || (i < count && new_ids[i] < old_ids[j])) {
+            g_array_append_val(added, new_ids[i]);
+            i++;
+        } else if(i == count || old_ids[j] < new_ids[i]) {
+            g_ptr_array_add(removed, alarm_store_lookup(store, old_ids[j]));
+            j++;
+        } else {
+            i++;
+            j++;
         }
     }
 
-    // Finally, check if any existing alarms no longer exist
-    GList* l = applet->alarms;
-    while(l) {
-        Alarm* a = ALARM(l->data);
-        if(!alarm_in_gsettings_list(a->id, values, count)) {
+    g_debug("\t%u added, %u removed", added->len, removed->len);
+
+    if(added->len > 0 || removed->len > 0) {
+        // Apply both in one batch
+        if(applet->list_window)
+            alarm_list_window_freeze(applet->list_window);
+
+        for(guint k = 0; k < removed->len; k++) {
+            Alarm* a = ALARM(g_ptr_array_index(removed, k));
 
             g_debug("\tDELETE alarm #%d %p", a->id, a);
 
@@ -67,15 +99,25 @@ void alarm_list_changed(GSettings* self, gchar* key, gpointer user_data)
 
             // Remove from list
             alarm_applet_alarms_remove_and_delete(applet, a);
+        }
+
+        for(guint k = 0; k < added->len; k++) {
+            const guint32 settings_id = g_array_index(added, guint32, k);
+            Alarm* a = alarm_new(applet, settings_id);
 
-            // Start loop from beginning
-            l = applet->alarms;
-            continue;
+            g_debug("\tADD alarm #%d %p", settings_id, a);
+
+            alarm_applet_alarms_add(applet, a);
         }
-        l = l->next;
+
+        if(applet->list_window)
+            alarm_list_window_thaw(applet->list_window);
     }
 
-    g_variant_unref(var);
+    g_array_free(added, TRUE);
+    g_ptr_array_free(removed, TRUE);
+    g_free(new_ids);
+    g_free(old_ids);
 }
 
 void alarm_show_label_changed(GSettings* self, gchar* key, gpointer user_data)
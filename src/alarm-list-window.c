@@ -11,6 +11,7 @@
 #include "alarm-list-window.h"
 #include "alarm-settings.h"
 #include "alarm-actions.h"
+#include "alarm-log.h"
 
 gboolean alarm_list_window_delete_event(GtkWidget* window, GdkEvent* event, gpointer data);
 
@@ -30,10 +31,14 @@ void alarm_list_window_snooze_menu_custom_activated(GtkMenuItem* menuitem, gpoin
 
 void alarm_list_window_snooze_menu_update(AlarmListWindow* list_window);
 
-static void alarm_list_window_update_row(AlarmListWindow* list_window, GtkTreeIter* iter);
+static void alarm_list_window_update_row(AlarmListWindow* list_window, GtkTreeIter* iter, AlarmDirtyFlags dirty);
 
 static void alarm_list_window_row_activated(GtkTreeView* self, GtkTreePath* path, GtkTreeViewColumn* column, gpointer user_data);
 
+static void alarm_list_window_select_alarm(AlarmListWindow* list_window, Alarm* alarm);
+
+static void alarm_list_window_map(GtkWidget* widget, gpointer data);
+
 /**
  * Create a new Alarm List Window
  */
@@ -72,10 +77,13 @@ AlarmListWindow* alarm_list_window_new(AlarmApplet* applet)
     list_window->alarm_icon = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(), ALARM_ICON, icon_size, GTK_ICON_LOOKUP_USE_BUILTIN, NULL);
     list_window->timer_icon = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(), TIMER_ICON, icon_size, GTK_ICON_LOOKUP_USE_BUILTIN, NULL);
 
+    list_window->rows = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)gtk_tree_iter_free);
+
     // Connect some signals
     selection = gtk_tree_view_get_selection(list_window->tree_view);
     g_signal_connect(selection, "changed", G_CALLBACK(alarm_list_window_selection_changed), applet);
     g_signal_connect(list_window->tree_view, "row-activated", G_CALLBACK(alarm_list_window_row_activated), applet);
+    g_signal_connect_after(list_window->window, "map", G_CALLBACK(alarm_list_window_map), list_window);
 
     // Update view every half a second for pretty countdowns
     g_timeout_add(500, (GSourceFunc)alarm_list_window_update_timer, applet);
@@ -139,30 +147,17 @@ gboolean alarm_list_window_delete_event(GtkWidget* window, GdkEvent* event, gpoi
  * Returns TRUE if found and sets iter to the location
  * Returns FALSE otherwise
  */
-gboolean alarm_list_window_find_alarm(GtkTreeModel* model, Alarm* alarm, GtkTreeIter* iter)
+gboolean alarm_list_window_find_alarm(AlarmListWindow* list_window, Alarm* alarm, GtkTreeIter* iter)
 {
-    GtkTreeIter it;
-    Alarm* a;
-    gboolean valid;
+    GtkTreeIter* it = g_hash_table_lookup(list_window->rows, alarm);
 
-    valid = gtk_tree_model_get_iter_first(model, &it);
+    if(!it)
+        return FALSE;
 
-    while(valid) {
-        gtk_tree_model_get(model, &it, COLUMN_ALARM, &a, -1);
+    if(iter)
+        *iter = *it;
 
-        if(a == alarm) {
-            if(iter) {
-                *iter = it;
-            }
-            g_object_unref(a);
-            return TRUE;
-        }
-
-        valid = gtk_tree_model_iter_next(model, &it);
-        g_object_unref(a);
-    }
-
-    return FALSE;
+    return TRUE;
 }
 
 /**
@@ -170,69 +165,137 @@ gboolean alarm_list_window_find_alarm(GtkTreeModel* model, Alarm* alarm, GtkTree
  */
 gboolean alarm_list_window_contains(AlarmListWindow* list_window, Alarm* alarm)
 {
-    return alarm_list_window_find_alarm(GTK_TREE_MODEL(list_window->model), alarm, NULL);
+    return alarm_list_window_find_alarm(list_window, alarm, NULL);
+}
+
+/* Properties shown in each column */
+#define DIRTY_COL_TYPE   (ALARM_DIRTY_TYPE)
+#define DIRTY_COL_REPEAT (ALARM_DIRTY_TYPE | ALARM_DIRTY_REPEAT | ALARM_DIRTY_CRON)
+#define DIRTY_COL_TIME   (DIRTY_COL_REPEAT | ALARM_DIRTY_TIME | ALARM_DIRTY_TIMESTAMP | ALARM_DIRTY_ACTIVE | ALARM_DIRTY_REMAINING)
+#define DIRTY_COL_LABEL  (ALARM_DIRTY_MESSAGE | ALARM_DIRTY_TRIGGERED)
+
+/*
+ * Add a column to be set, and initialize its value
+ */
+static GValue* alarm_list_window_row_value(gint* columns, GValue* values, gint* n, gint column, GType type)
+{
+    columns[*n] = column;
+    return g_value_init(&values[(*n)++], type);
 }
 
 /**
- * Update the row in the list at the position specified by iter
+ * Update the columns that show any of the dirty properties in the row at
+ * the position specified by iter
  */
-static void alarm_list_window_update_row(AlarmListWindow* list_window, GtkTreeIter* iter)
+static void alarm_list_window_update_row(AlarmListWindow* list_window, GtkTreeIter* iter, AlarmDirtyFlags dirty)
 {
     GtkTreeModel* model = GTK_TREE_MODEL(list_window->model);
     Alarm* a;
 
+    gint columns[ALARMS_N_COLUMNS];
+    GValue values[ALARMS_N_COLUMNS] = { G_VALUE_INIT };
+    gint n = 0;
+
     gchar tmp[200];
     gchar* tmp2;
+    gchar* repeat_col = NULL;
     struct tm tm;
 
-    GdkPixbuf* type_col;
-    GString* time_col;
-    gchar* label_col;
-
     // Get the alarm at iter
-    gtk_tree_model_get(GTK_TREE_MODEL(model), iter, COLUMN_ALARM, &a, -1);
+    gtk_tree_model_get(model, iter, COLUMN_ALARM, &a, -1);
 
-    // If alarm is running (active), show remaining time
-    if(a->active)
-        alarm_get_remain(a, &tm);
-    else
-        alarm_get_time(a, &tm);
+    // Leave the message unread until the window is shown, see alarm_list_window_map()
+    const gboolean show_label = gtk_widget_get_mapped(GTK_WIDGET(list_window->window));
 
-    if(a->type == ALARM_TYPE_CLOCK) {
-        type_col = list_window->alarm_icon;
-        strftime(tmp, sizeof(tmp), TIME_COL_CLOCK_FORMAT, &tm);
-    } else {
-        type_col = list_window->timer_icon;
-        strftime(tmp, sizeof(tmp), TIME_COL_TIMER_FORMAT, &tm);
+    if(dirty & DIRTY_COL_TYPE) {
+        g_value_set_object(alarm_list_window_row_value(columns, values, &n, COLUMN_TYPE, GDK_TYPE_PIXBUF),
+                           a->type == ALARM_TYPE_CLOCK ? list_window->alarm_icon : list_window->timer_icon);
+    }
+
+    // The repeat is kept in its own column, so that it isn't formatted
+    // again whenever the remaining time changes
+    if(dirty & DIRTY_COL_REPEAT) {
+        if(a->type == ALARM_TYPE_CLOCK && alarm_has_cron(a)) {
+            tmp2 = g_markup_escape_text(a->cron, -1);
+            repeat_col = g_strdup_printf(TIME_COL_REPEAT_FORMAT, tmp2);
+            g_free(tmp2);
+        } else if(a->type == ALARM_TYPE_CLOCK && a->repeat != ALARM_REPEAT_NONE) {
+            tmp2 = alarm_repeat_to_pretty(a->repeat);
+            repeat_col = g_strdup_printf(TIME_COL_REPEAT_FORMAT, tmp2);
+            g_free(tmp2);
+        }
+
+        g_value_set_string(alarm_list_window_row_value(columns, values, &n, COLUMN_REPEAT, G_TYPE_STRING), repeat_col);
+    } else if(dirty & DIRTY_COL_TIME) {
+        gtk_tree_model_get(model, iter, COLUMN_REPEAT, &repeat_col, -1);
     }
 
     // Create time column
-    time_col = g_string_new(tmp);
-    if(a->type == ALARM_TYPE_CLOCK && a->repeat != ALARM_REPEAT_NONE) {
-        tmp2 = alarm_repeat_to_pretty(a->repeat);
-        g_string_append_printf(time_col, TIME_COL_REPEAT_FORMAT, tmp2);
-        g_free(tmp2);
+    if(dirty & DIRTY_COL_TIME) {
+        // If alarm is running (active) or paused, show remaining time
+        if(a->active || alarm_is_paused(a))
+            alarm_get_remain(a, &tm);
+        else
+            alarm_get_time(a, &tm);
+
+        if(a->type == ALARM_TYPE_CLOCK)
+            strftime(tmp, sizeof(tmp), TIME_COL_CLOCK_FORMAT, &tm);
+        else
+            strftime(tmp, sizeof(tmp), TIME_COL_TIMER_FORMAT, &tm);
+
+        g_value_take_string(alarm_list_window_row_value(columns, values, &n, COLUMN_TIME, G_TYPE_STRING), g_strconcat(tmp, repeat_col, NULL));
     }
 
+    g_free(repeat_col);
+
     // Create label column
-    tmp2 = g_markup_escape_text(a->message, -1);
-    if(a->triggered) {
-        label_col = g_strdup_printf(LABEL_COL_TRIGGERED_FORMAT, tmp2);
-    } else {
-        label_col = g_strdup_printf(LABEL_COL_FORMAT, tmp2);
+    if(dirty & DIRTY_COL_LABEL) {
+        tmp2 = g_markup_escape_text(show_label ? alarm_get_message(a) : "", -1);
+        g_value_take_string(alarm_list_window_row_value(columns, values, &n, COLUMN_LABEL, G_TYPE_STRING),
+                            g_strdup_printf(a->triggered ? LABEL_COL_TRIGGERED_FORMAT : LABEL_COL_FORMAT, tmp2));
+        g_free(tmp2);
     }
-    g_free(tmp2);
 
-    gtk_list_store_set(GTK_LIST_STORE(model), iter, COLUMN_TYPE, type_col, COLUMN_TIME, time_col->str, COLUMN_LABEL, label_col, COLUMN_ACTIVE, a->active, COLUMN_TRIGGERED, a->triggered, -1);
+    if(dirty & ALARM_DIRTY_ACTIVE)
+        g_value_set_boolean(alarm_list_window_row_value(columns, values, &n, COLUMN_ACTIVE, G_TYPE_BOOLEAN), a->active);
 
-    // Restore icon visibility when an alarm is cleared / snoozed
-    if(!a->triggered) {
-        gtk_list_store_set(GTK_LIST_STORE(model), iter, COLUMN_SHOW_ICON, TRUE, -1);
+    if(dirty & ALARM_DIRTY_TRIGGERED) {
+        g_value_set_boolean(alarm_list_window_row_value(columns, values, &n, COLUMN_TRIGGERED, G_TYPE_BOOLEAN), a->triggered);
+
+        // Restore icon visibility when an alarm is cleared / snoozed
+        if(!a->triggered)
+            g_value_set_boolean(alarm_list_window_row_value(columns, values, &n, COLUMN_SHOW_ICON, G_TYPE_BOOLEAN), TRUE);
     }
 
+    if(n > 0)
+        gtk_list_store_set_valuesv(list_window->model, iter, columns, values, n);
+
+    for(gint i = 0; i < n; i++)
+        g_value_unset(&values[i]);
+
     g_object_unref(a);
-    g_string_free(time_col, TRUE);
-    g_free(label_col);
+}
+
+/**
+ * Fill in all rows once the window is shown
+ */
+static void alarm_list_window_map(GtkWidget* widget, gpointer data)
+{
+    AlarmListWindow* list_window = data;
+    GHashTableIter iter;
+    gpointer value;
+
+    gpointer key;
+
+    g_hash_table_iter_init(&iter, list_window->rows);
+    while(g_hash_table_iter_next(&iter, &key, &value)) {
+        Alarm* alarm = ALARM(key);
+
+        if(alarm->store)
+            alarm_store_take_dirty(alarm->store, alarm);
+
+        alarm_list_window_update_row(list_window, value, ALARM_DIRTY_ALL);
+    }
 }
 
 /**
@@ -245,8 +308,9 @@ void alarm_list_window_alarm_add(AlarmListWindow* list_window, Alarm* alarm)
 
     gtk_list_store_append(store, &iter);
     gtk_list_store_set(store, &iter, COLUMN_ALARM, alarm, -1);
+    g_hash_table_insert(list_window->rows, alarm, gtk_tree_iter_copy(&iter));
 
-    alarm_list_window_update_row(list_window, &iter);
+    alarm_list_window_update_row(list_window, &iter, ALARM_DIRTY_ALL);
 }
 
 /**
@@ -256,10 +320,14 @@ void alarm_list_window_alarm_update(AlarmListWindow* list_window, Alarm* alarm)
 {
     GtkTreeIter iter;
 
-    g_debug("AlarmListWindow alarm_update: %p (%s)", alarm, alarm->message);
+    alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow alarm_update: %p #%d", alarm, alarm->id);
+
+    if(alarm_list_window_find_alarm(list_window, alarm, &iter)) {
+        // Nothing left to do if the update timer got to it first
+        const AlarmDirtyFlags dirty = alarm->store ? alarm_store_take_dirty(alarm->store, alarm) : ALARM_DIRTY_ALL;
 
-    if(alarm_list_window_find_alarm(GTK_TREE_MODEL(list_window->model), alarm, &iter)) {
-        alarm_list_window_update_row(list_window, &iter);
+        if(dirty)
+            alarm_list_window_update_row(list_window, &iter, dirty);
     } else {
         g_warning("AlarmListWindow alarm_update: Could not find alarm %p", alarm);
     }
@@ -272,27 +340,58 @@ void alarm_list_window_alarm_remove(AlarmListWindow* list_window, Alarm* alarm)
 {
     GtkTreeIter iter;
 
-    if(alarm_list_window_find_alarm(GTK_TREE_MODEL(list_window->model), alarm, &iter)) {
+    if(alarm_list_window_find_alarm(list_window, alarm, &iter)) {
         gtk_list_store_remove(list_window->model, &iter);
+        g_hash_table_remove(list_window->rows, alarm);
     } else {
         g_warning("AlarmListWindow alarm_remove: Could not find alarm %p", alarm);
     }
 }
 
 /**
- * Add several alarms to the list window
+ * Hold off on sorting and redrawing while many alarms are added or
+ * removed. The view is detached from the model until the matching thaw.
  */
-void alarm_list_window_alarms_add(AlarmListWindow* list_window, GList* alarms)
+void alarm_list_window_freeze(AlarmListWindow* list_window)
 {
-    AlarmApplet* applet = list_window->applet;
+    if(list_window->frozen++ > 0)
+        return;
 
-    GList* l = NULL;
-    Alarm* a;
+    // Detaching clears the selection, remember it. The reference keeps a
+    // new alarm from taking its address if it is deleted meanwhile.
+    list_window->frozen_selection = alarm_list_window_get_selected_alarm(list_window);
+
+    gtk_tree_sortable_get_sort_column_id(GTK_TREE_SORTABLE(list_window->model), &list_window->frozen_sort_column, &list_window->frozen_sort_order);
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list_window->model), GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+
+    gtk_tree_view_set_model(list_window->tree_view, NULL);
+}
 
-    for(l = applet->alarms; l; l = l->next) {
-        a = ALARM(l->data);
+void alarm_list_window_thaw(AlarmListWindow* list_window)
+{
+    g_return_if_fail(list_window->frozen > 0);
+
+    if(--list_window->frozen > 0)
+        return;
+
+    // Sort once, then attach
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list_window->model), list_window->frozen_sort_column, list_window->frozen_sort_order);
+    gtk_tree_view_set_model(list_window->tree_view, GTK_TREE_MODEL(list_window->model));
 
-        alarm_list_window_alarm_add(list_window, a);
+    // Unless it has been removed meanwhile
+    if(list_window->frozen_selection && alarm_list_window_contains(list_window, list_window->frozen_selection))
+        alarm_list_window_select_alarm(list_window, list_window->frozen_selection);
+
+    g_clear_object(&list_window->frozen_selection);
+}
+
+/**
+ * Add several alarms to the list window
+ */
+void alarm_list_window_alarms_add(AlarmListWindow* list_window, AlarmStore* alarms)
+{
+    for(guint i = 0; i < alarm_store_get_size(alarms); i++) {
+        alarm_list_window_alarm_add(list_window, alarm_store_index(alarms, i));
     }
 }
 
@@ -302,34 +401,37 @@ void alarm_list_window_alarms_add(AlarmListWindow* list_window, GList* alarms)
 static gboolean alarm_list_window_update_timer(gpointer data)
 {
     AlarmApplet* applet = (AlarmApplet*)data;
+    AlarmStore* alarms = applet->alarms;
     GtkTreeModel* model = GTK_TREE_MODEL(applet->list_window->model);
     GtkTreeIter iter;
     Alarm* a;
     gboolean show_icon;
-    gboolean valid;
 
     // Don't attempt to update if the window is not mapped
-    if(!gtk_widget_get_mapped(GTK_WIDGET(applet->list_window->window)))
+    if(!gtk_widget_get_mapped(GTK_WIDGET(applet->list_window->window)) || applet->list_window->frozen)
         return TRUE;
 
-    valid = gtk_tree_model_get_iter_first(model, &iter);
+    // Always update active alarms regardless of the dirty state
+    const AlarmStoreFlags flags = ALARM_STORE_ACTIVE | ALARM_STORE_TRIGGERED | ALARM_STORE_DIRTY;
+
+    for(guint i = alarm_store_next(alarms, flags, 0); i < alarm_store_get_size(alarms); i = alarm_store_next(alarms, flags, i + 1)) {
+        a = alarm_store_index(alarms, i);
 
-    while(valid) {
-        gtk_tree_model_get(model, &iter, COLUMN_ALARM, &a, COLUMN_SHOW_ICON, &show_icon, -1);
+        AlarmDirtyFlags dirty = alarm_store_take_dirty(alarms, a);
 
-        // Always update active alarms regardless of the changed state
-        if(a->active || a->triggered || a->changed) {
-            alarm_list_window_update_row(applet->list_window, &iter);
+        // Only the remaining time of running alarms changes by itself
+        if(a->active)
+            dirty |= ALARM_DIRTY_TIMESTAMP;
+
+        if(alarm_list_window_find_alarm(applet->list_window, a, &iter)) {
+            alarm_list_window_update_row(applet->list_window, &iter, dirty);
 
             // Blink icon on triggered alarms
             if(a->triggered) {
+                gtk_tree_model_get(model, &iter, COLUMN_SHOW_ICON, &show_icon, -1);
                 gtk_list_store_set(GTK_LIST_STORE(model), &iter, COLUMN_SHOW_ICON, !show_icon, -1);
             }
-            a->changed = FALSE;
         }
-
-        valid = gtk_tree_model_iter_next(model, &iter);
-        g_object_unref(a);
     }
 
     // Keep updating
@@ -425,11 +527,10 @@ Alarm* alarm_list_window_get_selected_alarm(AlarmListWindow* list_window)
  */
 static void alarm_list_window_select_alarm(AlarmListWindow* list_window, Alarm* alarm)
 {
-    GtkTreeModel* model = GTK_TREE_MODEL(list_window->model);
     GtkTreeSelection* selection;
     GtkTreeIter iter;
 
-    if(!alarm_list_window_find_alarm(model, alarm, &iter)) {
+    if(!alarm_list_window_find_alarm(list_window, alarm, &iter)) {
         g_warning("AlarmListWindow select_alarm: Alarm %p not found!", alarm);
         return;
     }
@@ -484,8 +585,8 @@ void alarm_list_window_selection_changed(GtkTreeSelection* selection, gpointer d
     }
 
 
-    g_debug("AlarmListWindow: selection-changed from %s (%p) to %s (%p)", (a) ? a->message : "<none>", a,
-            (list_window->selected_alarm) ? list_window->selected_alarm->message : "<none>", list_window->selected_alarm);
+    alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: selection-changed from %s (%p) to %s (%p)", (a) ? alarm_get_message(a) : "<none>", a,
+            (list_window->selected_alarm) ? alarm_get_message(list_window->selected_alarm) : "<none>", list_window->selected_alarm);
 
     if(list_window->selected_alarm)
         g_object_unref(list_window->selected_alarm);
@@ -505,7 +606,7 @@ void alarm_list_window_enable_toggled(GtkCellRendererToggle* cell_renderer, gcha
     if(gtk_tree_model_get_iter_from_string(model, &iter, path)) {
         gtk_tree_model_get(model, &iter, COLUMN_ALARM, &a, -1);
 
-        g_debug("AlarmListWindow enable toggled on %p", a);
+        alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow enable toggled on %p", a);
 
         // Reset reordered flag
         list_window->reordered = FALSE;
@@ -567,7 +668,7 @@ void alarm_list_window_snooze_menu_activated(GtkMenuItem* menuitem, gpointer dat
 
         mins = g_strtod(parts[i - 1], NULL);
 
-        g_debug("AlarmListWindow: snooze-menu activated: Snooze for %d mins!", mins);
+        alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: snooze-menu activated: Snooze for %d mins!", mins);
 
         applet->snooze_mins = mins;
 
@@ -587,7 +688,7 @@ void alarm_list_window_snooze_menu_custom_activated(GtkMenuItem* menuitem, gpoin
     Alarm* a;
     guint mins;
 
-    g_debug("AlarmListWindow: snooze-menu custom activated");
+    alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: snooze-menu custom activated");
 
     dialog = GTK_WIDGET(gtk_builder_get_object(applet->ui, "snooze-dialog"));
     spin = GTK_WIDGET(gtk_builder_get_object(applet->ui, "snooze-spin"));
@@ -599,7 +700,7 @@ void alarm_list_window_snooze_menu_custom_activated(GtkMenuItem* menuitem, gpoin
     if(response == GTK_RESPONSE_OK) {
         mins = (gint)gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
         if((a = alarm_list_window_get_selected_alarm(list_window))) {
-            g_debug("AlarmListWindow: Snooze Custom: %s for %d mins", a->message, mins);
+            alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: Snooze Custom: %s for %d mins", alarm_get_message(a), mins);
             alarm_snooze(a, mins * 60);
             g_object_unref(a);
         }
@@ -618,7 +719,7 @@ void alarm_list_window_snooze_menu_update(AlarmListWindow* list_window)
     const gchar* name;
     GtkMenuItem* item;
 
-    g_debug("AlarmListWindow: menu_update to %d", applet->snooze_mins);
+    alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: menu_update to %d", applet->snooze_mins);
 
     GList* list = gtk_container_get_children(GTK_CONTAINER(menu));
     block_list(list, alarm_list_window_snooze_menu_activated);
@@ -629,7 +730,7 @@ void alarm_list_window_snooze_menu_update(AlarmListWindow* list_window)
         if(g_strcmp0(name, target_name) == 0) {
             g_object_set(item, "active", TRUE, NULL);
 
-            g_debug("AlarmListWindow: menu_update to %s", name);
+            alarm_log_debug(ALARM_LOG_LIST_WINDOW, "AlarmListWindow: menu_update to %s", name);
         }
     }
 
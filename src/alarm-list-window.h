@@ -24,6 +24,7 @@ typedef enum {
     COLUMN_ACTIVE,
     COLUMN_TRIGGERED,
     COLUMN_SHOW_ICON,
+    COLUMN_REPEAT, /* Repeat shown under the time, kept to build it from */
     ALARMS_N_COLUMNS,
 } AlarmListColumn;
 
@@ -52,6 +53,14 @@ struct _AlarmListWindow {
 
     GdkPixbuf* alarm_icon;
     GdkPixbuf* timer_icon;
+
+    GHashTable* rows; // Alarm -> GtkTreeIter, the store's iters persist
+
+    /* Batch updates */
+    guint frozen;
+    Alarm* frozen_selection;
+    gint frozen_sort_column;
+    GtkSortType frozen_sort_order;
 };
 
 // #define TIME_COL_FORMAT "<span font='Bold 11'>%H:%M:%S</span>"
@@ -83,9 +92,13 @@ void alarm_list_window_alarm_update(AlarmListWindow* list_window, Alarm* alarm);
 
 void alarm_list_window_alarm_remove(AlarmListWindow* list_window, Alarm* alarm);
 
-void alarm_list_window_alarms_add(AlarmListWindow* list_window, GList* alarms);
+void alarm_list_window_alarms_add(AlarmListWindow* list_window, AlarmStore* alarms);
+
+void alarm_list_window_freeze(AlarmListWindow* list_window);
+
+void alarm_list_window_thaw(AlarmListWindow* list_window);
 
-gboolean alarm_list_window_find_alarm(GtkTreeModel* model, Alarm* alarm, GtkTreeIter* iter);
+gboolean alarm_list_window_find_alarm(AlarmListWindow* list_window, Alarm* alarm, GtkTreeIter* iter);
 
 gboolean alarm_list_window_contains(AlarmListWindow* list_window, Alarm* alarm);
 
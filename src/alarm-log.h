@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-log.h -- Debug messages that cost nothing when disabled
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_LOG_H_
+#define ALARM_LOG_H_
+
+#include <glib.h>
+#include <config.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Log domains of the subsystems, so that their debug messages can be
+ * enabled separately through G_MESSAGES_DEBUG
+ */
+#define ALARM_LOG_ALARM       G_LOG_DOMAIN "-alarm"
+#define ALARM_LOG_STORAGE     G_LOG_DOMAIN "-storage"
+#define ALARM_LOG_LIST_WINDOW G_LOG_DOMAIN "-list-window"
+
+/*
+ * Whether debug messages of a domain would be shown. Work that is only
+ * done for a message should be skipped otherwise.
+ */
+#ifndef ENABLE_DEBUG_LOG
+#define alarm_log_debug_enabled(domain) FALSE
+#elif GLIB_CHECK_VERSION(2, 68, 0)
+#define alarm_log_debug_enabled(domain) (!g_log_writer_default_would_drop(G_LOG_LEVEL_DEBUG, (domain)))
+#else
+#define alarm_log_debug_enabled(domain) TRUE
+#endif
+
+/*
+ * Like g_debug(), but the arguments are only evaluated if the message
+ * would be shown
+ */
+#define alarm_log_debug(domain, ...)                         \
+    G_STMT_START {                                           \
+        if(alarm_log_debug_enabled(domain))                  \
+            g_log((domain), G_LOG_LEVEL_DEBUG, __VA_ARGS__); \
+    } G_STMT_END
+
+G_END_DECLS
+
+#endif /*ALARM_LOG_H_*/
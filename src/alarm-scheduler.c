@@ -0,0 +1,937 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-scheduler.c -- Deadline-ordered alarm scheduler
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#include <glib-unix.h>
+#endif
+
+#include "alarm-scheduler.h"
+
+/*
+ * GLib timeouts run on the monotonic clock, which neither follows the wall
+ * clock nor advances during suspend. When we have to fall back to them,
+ * don't sleep for longer than this so that either is noticed eventually.
+ */
+#define ALARM_SCHEDULER_MAX_SLEEP (60 * G_USEC_PER_SEC)
+
+/*
+ * Storage of the queued entries. Besides the binary heap, a hierarchical
+ * timing wheel is available for very large numbers of alarms.
+ */
+typedef struct {
+    gpointer (*new)(gint64 now);
+    void (*free)(gpointer queue);
+    // Queue an entry, now being the current time on the scheduler's clock
+    void (*insert)(gpointer queue, AlarmSchedulerEntry* entry, gint64 now);
+    void (*remove)(gpointer queue, AlarmSchedulerEntry* entry);
+    void (*move)(gpointer queue, AlarmSchedulerEntry* entry, gint64 deadline);
+    // Time to wake up at next. May be earlier than the earliest deadline.
+    gint64 (*next)(gpointer queue);
+    // Remove the entries due at now and add them to due in deadline order
+    void (*collect)(gpointer queue, gint64 now, GPtrArray* due);
+    guint (*size)(gpointer queue);
+    void (*foreach)(gpointer queue, GFunc func, gpointer data);
+} AlarmSchedulerQueueFuncs;
+
+struct _AlarmScheduler {
+    const AlarmSchedulerQueueFuncs* queue_funcs;
+    gpointer queue;
+
+    AlarmSchedulerClock clock;
+    GMainContext* context; // Context the timer is dispatched from
+    GMutex lock;           // The scheduler may be used from another thread than its context's
+    gint timer_fd;         // timerfd on the scheduler's clock, or -1 if unavailable
+    GSource* timer_source; // Source watching timer_fd, or the fallback timeout
+    gboolean armed;        // Whether the timer is waiting for a deadline
+    gint64 timer_deadline; // Deadline the timer has been armed for
+    gboolean dispatching;  // Defer arming until the callbacks have returned
+    guint frozen;          // Leave the timer disarmed until thawed
+
+    AlarmSchedulerFunc func;
+    AlarmSchedulerClockFunc clock_func;
+    gpointer func_data;
+    AlarmSchedulerRefFunc data_ref; // Called on the data of due entries with the lock held
+    GDestroyNotify data_unref;
+};
+
+static AlarmSchedulerBackend alarm_scheduler_default_backend = ALARM_SCHEDULER_BACKEND_HEAP;
+
+static void alarm_scheduler_arm(AlarmScheduler* scheduler);
+
+/*
+ * Heap {{
+ */
+
+/* Binary min-heap of AlarmSchedulerEntry, ordered by deadline */
+#define HEAP_ENTRY(h, i) ((AlarmSchedulerEntry*)g_ptr_array_index((h), (i)))
+
+static inline void heap_set(GPtrArray* heap, guint i, AlarmSchedulerEntry* entry)
+{
+    g_ptr_array_index(heap, i) = entry;
+    entry->index = i + 1;
+}
+
+static void heap_sift_up(GPtrArray* heap, guint i)
+{
+    AlarmSchedulerEntry* entry = HEAP_ENTRY(heap, i);
+
+    while(i > 0) {
+        guint parent = (i - 1) / 2;
+        AlarmSchedulerEntry* p = HEAP_ENTRY(heap, parent);
+
+        if(p->deadline <= entry->deadline)
+            break;
+
+        heap_set(heap, i, p);
+        i = parent;
+    }
+
+    heap_set(heap, i, entry);
+}
+
+static void heap_sift_down(GPtrArray* heap, guint i)
+{
+    AlarmSchedulerEntry* entry = HEAP_ENTRY(heap, i);
+    const guint len = heap->len;
+
+    for(;;) {
+        guint child = 2 * i + 1;
+        if(child >= len)
+            break;
+
+        // Pick the earliest of the two children
+        if(child + 1 < len && HEAP_ENTRY(heap, child + 1)->deadline < HEAP_ENTRY(heap, child)->deadline)
+            child++;
+
+        if(entry->deadline <= HEAP_ENTRY(heap, child)->deadline)
+            break;
+
+        heap_set(heap, i, HEAP_ENTRY(heap, child));
+        i = child;
+    }
+
+    heap_set(heap, i, entry);
+}
+
+static void heap_remove_at(GPtrArray* heap, guint i)
+{
+    AlarmSchedulerEntry* entry = HEAP_ENTRY(heap, i);
+    AlarmSchedulerEntry* last = g_ptr_array_remove_index(heap, heap->len - 1);
+
+    entry->index = 0;
+
+    if(last == entry)
+        return;
+
+    // Move the last entry into the hole and restore the heap property
+    heap_set(heap, i, last);
+
+    if(i > 0 && HEAP_ENTRY(heap, (i - 1) / 2)->deadline > last->deadline)
+        heap_sift_up(heap, i);
+    else
+        heap_sift_down(heap, i);
+}
+
+static gpointer heap_new(gint64 now)
+{
+    return g_ptr_array_new();
+}
+
+static void heap_free(gpointer queue)
+{
+    GPtrArray* heap = queue;
+
+    for(guint i = 0; i < heap->len; i++)
+        HEAP_ENTRY(heap, i)->index = 0;
+
+    g_ptr_array_free(heap, TRUE);
+}
+
+static void heap_insert(gpointer queue, AlarmSchedulerEntry* entry, gint64 now)
+{
+    GPtrArray* heap = queue;
+
+    g_ptr_array_add(heap, entry);
+    heap_sift_up(heap, heap->len - 1);
+}
+
+static void heap_remove(gpointer queue, AlarmSchedulerEntry* entry)
+{
+    GPtrArray* heap = queue;
+
+    g_return_if_fail(entry->index <= heap->len && HEAP_ENTRY(heap, entry->index - 1) == entry);
+
+    heap_remove_at(heap, entry->index - 1);
+}
+
+static void heap_move(gpointer queue, AlarmSchedulerEntry* entry, gint64 deadline)
+{
+    const gint64 old = entry->deadline;
+
+    entry->deadline = deadline;
+
+    if(deadline < old)
+        heap_sift_up(queue, entry->index - 1);
+    else if(deadline > old)
+        heap_sift_down(queue, entry->index - 1);
+}
+
+static gint64 heap_next(gpointer queue)
+{
+    GPtrArray* heap = queue;
+
+    return heap->len > 0 ? HEAP_ENTRY(heap, 0)->deadline : G_MAXINT64;
+}
+
+static void heap_collect(gpointer queue, gint64 now, GPtrArray* due)
+{
+    GPtrArray* heap = queue;
+
+    while(heap->len > 0 && HEAP_ENTRY(heap, 0)->deadline <= now) {
+        g_ptr_array_add(due, HEAP_ENTRY(heap, 0));
+        heap_remove_at(heap, 0);
+    }
+}
+
+static guint heap_size(gpointer queue)
+{
+    return ((GPtrArray*)queue)->len;
+}
+
+static void heap_foreach(gpointer queue, GFunc func, gpointer data)
+{
+    g_ptr_array_foreach(queue, func, data);
+}
+
+static const AlarmSchedulerQueueFuncs heap_funcs = {
+    heap_new, heap_free, heap_insert, heap_remove, heap_move, heap_next, heap_collect, heap_size, heap_foreach,
+};
+
+/*
+ * }} Heap
+ */
+
+/*
+ * Timing wheel {{
+ */
+
+/*
+ * Entries are hashed into slots of one second, minute, hour and day,
+ * depending on how far away their deadline is, so that queueing and
+ * cancelling are O(1). As time advances, the slot of each new minute,
+ * hour and day is cascaded down to the finer levels. Deadlines past
+ * the last day slot wait in an overflow list that is revisited daily.
+ *
+ * The wheel keeps per-second resolution only for the current minute. The
+ * timer is armed for the exact deadline there, and for slot boundaries
+ * otherwise.
+ */
+
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_SLOTS 64
+
+static const guint wheel_slots[WHEEL_LEVELS] = { 60, 60, 24, WHEEL_MAX_SLOTS };
+static const gint64 wheel_width[WHEEL_LEVELS] = { 1, 60, 60 * 60, 24 * 60 * 60 };
+
+/* entry->index for entries in the overflow list */
+#define WHEEL_OVERFLOW_INDEX (WHEEL_LEVELS * WHEEL_MAX_SLOTS + 1)
+
+typedef struct {
+    AlarmSchedulerEntry* slots[WHEEL_LEVELS][WHEEL_MAX_SLOTS];
+    guint64 occupied[WHEEL_LEVELS]; // Bitmask of the non-empty slots
+    AlarmSchedulerEntry* overflow;
+    gint64 current; // Second the wheel has advanced to
+    guint size;
+} AlarmSchedulerWheel;
+
+static inline guint wheel_ctz(guint64 bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    guint n = 0;
+
+    while(!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+static inline AlarmSchedulerEntry** wheel_head(AlarmSchedulerWheel* wheel, guint index)
+{
+    if(index == WHEEL_OVERFLOW_INDEX)
+        return &wheel->overflow;
+
+    return &wheel->slots[(index - 1) / WHEEL_MAX_SLOTS][(index - 1) % WHEEL_MAX_SLOTS];
+}
+
+static void wheel_link(AlarmSchedulerWheel* wheel, AlarmSchedulerEntry* entry, guint index)
+{
+    AlarmSchedulerEntry** head = wheel_head(wheel, index);
+
+    entry->index = index;
+    entry->prev = NULL;
+    entry->next = *head;
+
+    if(*head)
+        (*head)->prev = entry;
+
+    *head = entry;
+
+    if(index != WHEEL_OVERFLOW_INDEX)
+        wheel->occupied[(index - 1) / WHEEL_MAX_SLOTS] |= G_GUINT64_CONSTANT(1) << ((index - 1) % WHEEL_MAX_SLOTS);
+}
+
+static void wheel_unlink(AlarmSchedulerWheel* wheel, AlarmSchedulerEntry* entry)
+{
+    AlarmSchedulerEntry** head = wheel_head(wheel, entry->index);
+
+    if(entry->next)
+        entry->next->prev = entry->prev;
+
+    if(entry->prev)
+        entry->prev->next = entry->next;
+    else
+        *head = entry->next;
+
+    if(*head == NULL && entry->index != WHEEL_OVERFLOW_INDEX)
+        wheel->occupied[(entry->index - 1) / WHEEL_MAX_SLOTS] &= ~(G_GUINT64_CONSTANT(1) << ((entry->index - 1) % WHEEL_MAX_SLOTS));
+
+    entry->index = 0;
+    entry->next = entry->prev = NULL;
+}
+
+/*
+ * Put an entry in the finest level whose slots don't wrap before its deadline
+ */
+static void wheel_place(AlarmSchedulerWheel* wheel, AlarmSchedulerEntry* entry)
+{
+    // Deadlines already passed are due in the current second
+    const gint64 t = MAX(entry->deadline / G_USEC_PER_SEC, wheel->current);
+    const gint64 current = wheel->current;
+
+    for(guint level = 0; level < WHEEL_LEVELS; level++) {
+        gboolean fits;
+
+        if(level + 1 < WHEEL_LEVELS)
+            fits = t / wheel_width[level + 1] == current / wheel_width[level + 1];
+        else
+            fits = t / wheel_width[level] - current / wheel_width[level] < wheel_slots[level];
+
+        if(fits) {
+            wheel_link(wheel, entry, level * WHEEL_MAX_SLOTS + (t / wheel_width[level]) % wheel_slots[level] + 1);
+            return;
+        }
+    }
+
+    wheel_link(wheel, entry, WHEEL_OVERFLOW_INDEX);
+}
+
+static void wheel_replace_list(AlarmSchedulerWheel* wheel, AlarmSchedulerEntry** head)
+{
+    AlarmSchedulerEntry* entry = *head;
+
+    *head = NULL;
+
+    while(entry) {
+        AlarmSchedulerEntry* next = entry->next;
+
+        wheel_place(wheel, entry);
+        entry = next;
+    }
+}
+
+/*
+ * Spread the slots starting at the current second over the finer levels
+ */
+static void wheel_cascade(AlarmSchedulerWheel* wheel)
+{
+    const gint64 current = wheel->current;
+
+    if(current % wheel_width[WHEEL_LEVELS - 1] == 0)
+        wheel_replace_list(wheel, &wheel->overflow);
+
+    for(guint level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if(current % wheel_width[level] != 0)
+            continue;
+
+        const guint slot = (current / wheel_width[level]) % wheel_slots[level];
+
+        wheel->occupied[level] &= ~(G_GUINT64_CONSTANT(1) << slot);
+        wheel_replace_list(wheel, &wheel->slots[level][slot]);
+    }
+}
+
+static gpointer wheel_new(gint64 now)
+{
+    AlarmSchedulerWheel* wheel = g_new0(AlarmSchedulerWheel, 1);
+
+    wheel->current = now / G_USEC_PER_SEC;
+
+    return wheel;
+}
+
+static void wheel_foreach(gpointer queue, GFunc func, gpointer data)
+{
+    AlarmSchedulerWheel* wheel = queue;
+    AlarmSchedulerEntry* entry;
+
+    for(guint level = 0; level < WHEEL_LEVELS; level++) {
+        for(guint slot = 0; slot < wheel_slots[level]; slot++) {
+            for(entry = wheel->slots[level][slot]; entry; entry = entry->next)
+                func(entry, data);
+        }
+    }
+
+    for(entry = wheel->overflow; entry; entry = entry->next)
+        func(entry, data);
+}
+
+static void wheel_clear_entry(gpointer entry, gpointer data)
+{
+    ((AlarmSchedulerEntry*)entry)->index = 0;
+}
+
+static void wheel_free(gpointer queue)
+{
+    wheel_foreach(queue, wheel_clear_entry, NULL);
+    g_free(queue);
+}
+
+static void wheel_insert(gpointer queue, AlarmSchedulerEntry* entry, gint64 now)
+{
+    AlarmSchedulerWheel* wheel = queue;
+
+    // Nothing has advanced the wheel since it was last emptied
+    if(wheel->size == 0)
+        wheel->current = now / G_USEC_PER_SEC;
+
+    wheel_place(wheel, entry);
+    wheel->size++;
+}
+
+static void wheel_remove(gpointer queue, AlarmSchedulerEntry* entry)
+{
+    AlarmSchedulerWheel* wheel = queue;
+
+    wheel_unlink(wheel, entry);
+    wheel->size--;
+}
+
+static void wheel_move(gpointer queue, AlarmSchedulerEntry* entry, gint64 deadline)
+{
+    AlarmSchedulerWheel* wheel = queue;
+
+    wheel_unlink(wheel, entry);
+    entry->deadline = deadline;
+    wheel_place(wheel, entry);
+}
+
+/*
+ * Second of the next minute, hour or day slot that has to be cascaded.
+ * The slots before it are empty, so the wheel can skip straight to it.
+ */
+static gint64 wheel_next_cascade(AlarmSchedulerWheel* wheel)
+{
+    const gint64 current = wheel->current;
+
+    // The start of the next non-empty minute and hour slot
+    for(guint level = 1; level < WHEEL_LEVELS - 1; level++) {
+        const guint pos = (current / wheel_width[level]) % wheel_slots[level];
+        const guint64 bits = wheel->occupied[level] & ~((G_GUINT64_CONSTANT(2) << pos) - 1);
+
+        if(bits)
+            return current / wheel_width[level + 1] * wheel_width[level + 1] + wheel_ctz(bits) * wheel_width[level];
+    }
+
+    // The start of the next non-empty day, which wraps around
+    const gint64 day = current / wheel_width[WHEEL_LEVELS - 1];
+    const guint64 days = wheel->occupied[WHEEL_LEVELS - 1];
+    const guint base = (day + 1) % WHEEL_MAX_SLOTS;
+    const guint64 bits = base ? (days >> base) | (days << (WHEEL_MAX_SLOTS - base)) : days;
+
+    if(bits)
+        return (day + 1 + wheel_ctz(bits)) * wheel_width[WHEEL_LEVELS - 1];
+
+    // Only the overflow is left, which is revisited the next day
+    return (day + 1) * wheel_width[WHEEL_LEVELS - 1];
+}
+
+static gint64 wheel_next(gpointer queue)
+{
+    AlarmSchedulerWheel* wheel = queue;
+    const gint64 current = wheel->current;
+
+    if(wheel->size == 0)
+        return G_MAXINT64;
+
+    // The rest of this minute, exact
+    const guint pos = current % wheel_slots[0];
+    const guint64 bits = wheel->occupied[0] & ~((G_GUINT64_CONSTANT(1) << pos) - 1);
+
+    if(bits) {
+        gint64 deadline = G_MAXINT64;
+
+        for(AlarmSchedulerEntry* entry = wheel->slots[0][wheel_ctz(bits)]; entry; entry = entry->next)
+            deadline = MIN(deadline, entry->deadline);
+
+        return deadline;
+    }
+
+    return wheel_next_cascade(wheel) * G_USEC_PER_SEC;
+}
+
+static gint wheel_compare_deadline(gconstpointer a, gconstpointer b)
+{
+    const gint64 da = (*(AlarmSchedulerEntry**)a)->deadline;
+    const gint64 db = (*(AlarmSchedulerEntry**)b)->deadline;
+
+    return (da > db) - (da < db);
+}
+
+static void wheel_collect(gpointer queue, gint64 now, GPtrArray* due)
+{
+    AlarmSchedulerWheel* wheel = queue;
+    const gint64 target = now / G_USEC_PER_SEC;
+
+    for(;;) {
+        AlarmSchedulerEntry* entry = wheel->slots[0][wheel->current % wheel_slots[0]];
+
+        while(entry) {
+            AlarmSchedulerEntry* next = entry->next;
+
+            if(entry->deadline <= now) {
+                wheel_remove(wheel, entry);
+                g_ptr_array_add(due, entry);
+            }
+
+            entry = next;
+        }
+
+        if(wheel->current >= target)
+            break;
+
+        if(wheel->size == 0) {
+            wheel->current = target;
+            break;
+        }
+
+        // Skip to the next second with entries in this minute, or else to
+        // the next slot that has to be cascaded. Everything in between is
+        // empty, however long ago the wheel was last advanced.
+        const guint pos = wheel->current % wheel_slots[0];
+        const guint64 bits = wheel->occupied[0] & ~((G_GUINT64_CONSTANT(2) << pos) - 1);
+        const gint64 next = bits ? wheel->current - pos + wheel_ctz(bits) : wheel_next_cascade(wheel);
+
+        if(next > target) {
+            wheel->current = target;
+            continue;
+        }
+
+        wheel->current = next;
+
+        if(!bits)
+            wheel_cascade(wheel);
+    }
+
+    // Slots are not ordered within
+    g_ptr_array_sort(due, wheel_compare_deadline);
+}
+
+static guint wheel_size(gpointer queue)
+{
+    return ((AlarmSchedulerWheel*)queue)->size;
+}
+
+static const AlarmSchedulerQueueFuncs wheel_funcs = {
+    wheel_new, wheel_free, wheel_insert, wheel_remove, wheel_move, wheel_next, wheel_collect, wheel_size, wheel_foreach,
+};
+
+/*
+ * }} Timing wheel
+ */
+
+static const AlarmSchedulerQueueFuncs* alarm_scheduler_backends[] = {
+    [ALARM_SCHEDULER_BACKEND_HEAP] = &heap_funcs,
+    [ALARM_SCHEDULER_BACKEND_WHEEL] = &wheel_funcs,
+};
+
+static const gchar* alarm_scheduler_backend_names[] = {
+    [ALARM_SCHEDULER_BACKEND_HEAP] = "heap",
+    [ALARM_SCHEDULER_BACKEND_WHEEL] = "wheel",
+};
+
+gboolean alarm_scheduler_backend_from_string(const gchar* str, AlarmSchedulerBackend* backend)
+{
+    for(guint i = 0; i < G_N_ELEMENTS(alarm_scheduler_backend_names); i++) {
+        if(g_strcmp0(str, alarm_scheduler_backend_names[i]) == 0) {
+            *backend = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void alarm_scheduler_set_default_backend(AlarmSchedulerBackend backend)
+{
+    g_debug("AlarmScheduler: using the %s backend", alarm_scheduler_backend_names[backend]);
+
+    alarm_scheduler_default_backend = backend;
+}
+
+gint64 alarm_scheduler_clock_get_time(AlarmSchedulerClock clock)
+{
+#ifdef CLOCK_BOOTTIME
+    if(clock == ALARM_SCHEDULER_CLOCK_BOOTTIME) {
+        struct timespec ts;
+
+        if(clock_gettime(CLOCK_BOOTTIME, &ts) == 0)
+            return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+    }
+#endif
+
+    if(clock == ALARM_SCHEDULER_CLOCK_REALTIME)
+        return g_get_real_time();
+
+    return g_get_monotonic_time();
+}
+
+static void alarm_scheduler_dispatch(AlarmScheduler* scheduler)
+{
+    GPtrArray* due = g_ptr_array_new();
+    gint64 deadline = 0;
+
+    g_mutex_lock(&scheduler->lock);
+
+    scheduler->armed = FALSE;
+    scheduler->dispatching = TRUE;
+
+    // Collect everything that is due before dispatching, so that entries
+    // re-added by the callback can't make us loop
+    if(!scheduler->frozen)
+        scheduler->queue_funcs->collect(scheduler->queue, alarm_scheduler_clock_get_time(scheduler->clock), due);
+
+    // The entries may be moved once the lock is dropped
+    if(due->len > 0)
+        deadline = ((AlarmSchedulerEntry*)g_ptr_array_index(due, 0))->deadline;
+
+    // Once the lock is dropped, nothing stops the owners from going away
+    if(scheduler->data_ref) {
+        for(guint i = 0; i < due->len; i++)
+            scheduler->data_ref(((AlarmSchedulerEntry*)g_ptr_array_index(due, i))->data);
+    }
+
+    // The callback may add and remove entries
+    g_mutex_unlock(&scheduler->lock);
+
+    if(due->len > 0)
+        scheduler->func(scheduler, due, deadline, scheduler->func_data);
+
+    // The entries may be gone after this, only their data is kept
+    if(scheduler->data_unref) {
+        GPtrArray* data = g_ptr_array_sized_new(due->len);
+
+        for(guint i = 0; i < due->len; i++)
+            g_ptr_array_add(data, ((AlarmSchedulerEntry*)g_ptr_array_index(due, i))->data);
+
+        for(guint i = 0; i < data->len; i++)
+            scheduler->data_unref(g_ptr_array_index(data, i));
+
+        g_ptr_array_free(data, TRUE);
+    }
+
+    g_ptr_array_free(due, TRUE);
+
+    g_mutex_lock(&scheduler->lock);
+    scheduler->dispatching = FALSE;
+    alarm_scheduler_arm(scheduler);
+    g_mutex_unlock(&scheduler->lock);
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+static gboolean alarm_scheduler_timerfd_cb(gint fd, GIOCondition condition, gpointer data)
+{
+    AlarmScheduler* scheduler = data;
+    guint64 expirations;
+
+    if(read(fd, &expirations, sizeof(expirations)) < 0) {
+        if(errno == ECANCELED) {
+            // TFD_TIMER_CANCEL_ON_SET: the system time was changed under us
+            g_debug("AlarmScheduler: system time changed");
+
+            if(scheduler->clock_func) {
+                g_mutex_lock(&scheduler->lock);
+                scheduler->dispatching = TRUE;
+                g_mutex_unlock(&scheduler->lock);
+
+                scheduler->clock_func(scheduler, scheduler->func_data);
+
+                g_mutex_lock(&scheduler->lock);
+                scheduler->dispatching = FALSE;
+                g_mutex_unlock(&scheduler->lock);
+            }
+        } else if(errno != EAGAIN && errno != EINTR) {
+            g_warning("AlarmScheduler: Could not read timer: %s", g_strerror(errno));
+        }
+    }
+
+    // Arming the timer again also clears the cancelled state
+    alarm_scheduler_dispatch(scheduler);
+
+    return G_SOURCE_CONTINUE;
+}
+#endif
+
+static gboolean alarm_scheduler_timeout(gpointer data)
+{
+    AlarmScheduler* scheduler = data;
+
+    // Unless it has already been replaced from another thread
+    g_mutex_lock(&scheduler->lock);
+    if(scheduler->timer_source == g_main_current_source())
+        g_clear_pointer(&scheduler->timer_source, g_source_unref);
+    g_mutex_unlock(&scheduler->lock);
+
+    alarm_scheduler_dispatch(scheduler);
+
+    return G_SOURCE_REMOVE;
+}
+
+AlarmScheduler* alarm_scheduler_new(AlarmSchedulerClock clock, AlarmSchedulerFunc func, gpointer data)
+{
+    return alarm_scheduler_new_full(clock, alarm_scheduler_default_backend, func, data);
+}
+
+AlarmScheduler* alarm_scheduler_new_full(AlarmSchedulerClock clock, AlarmSchedulerBackend backend, AlarmSchedulerFunc func, gpointer data)
+{
+    return alarm_scheduler_new_with_context(clock, backend, NULL, func, data);
+}
+
+AlarmScheduler* alarm_scheduler_new_with_context(AlarmSchedulerClock clock, AlarmSchedulerBackend backend, GMainContext* context, AlarmSchedulerFunc func, gpointer data)
+{
+    AlarmScheduler* scheduler = g_new0(AlarmScheduler, 1);
+
+    scheduler->queue_funcs = alarm_scheduler_backends[backend];
+    scheduler->queue = scheduler->queue_funcs->new(alarm_scheduler_clock_get_time(clock));
+    scheduler->clock = clock;
+    scheduler->context = context ? g_main_context_ref(context) : NULL;
+    scheduler->func = func;
+    scheduler->func_data = data;
+    scheduler->timer_fd = -1;
+    g_mutex_init(&scheduler->lock);
+
+#ifdef HAVE_SYS_TIMERFD_H
+    if(clock == ALARM_SCHEDULER_CLOCK_REALTIME)
+        scheduler->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+#ifdef CLOCK_BOOTTIME
+    else
+        scheduler->timer_fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+#endif
+
+    if(scheduler->timer_fd >= 0) {
+        scheduler->timer_source = g_unix_fd_source_new(scheduler->timer_fd, G_IO_IN);
+        g_source_set_callback(scheduler->timer_source, (GSourceFunc)alarm_scheduler_timerfd_cb, scheduler, NULL);
+        g_source_attach(scheduler->timer_source, scheduler->context);
+    } else {
+        g_warning("AlarmScheduler: Could not create timer, falling back to timeouts: %s", g_strerror(errno));
+    }
+#endif
+
+    return scheduler;
+}
+
+void alarm_scheduler_free(AlarmScheduler* scheduler)
+{
+    if(scheduler->timer_source) {
+        g_source_destroy(scheduler->timer_source);
+        g_source_unref(scheduler->timer_source);
+    }
+
+    if(scheduler->timer_fd >= 0)
+        close(scheduler->timer_fd);
+
+    if(scheduler->context)
+        g_main_context_unref(scheduler->context);
+
+    scheduler->queue_funcs->free(scheduler->queue);
+    g_mutex_clear(&scheduler->lock);
+    g_free(scheduler);
+}
+
+void alarm_scheduler_set_clock_changed_func(AlarmScheduler* scheduler, AlarmSchedulerClockFunc func)
+{
+    scheduler->clock_func = func;
+}
+
+void alarm_scheduler_set_data_funcs(AlarmScheduler* scheduler, AlarmSchedulerRefFunc ref_func, GDestroyNotify unref_func)
+{
+    g_mutex_lock(&scheduler->lock);
+    scheduler->data_ref = ref_func;
+    scheduler->data_unref = unref_func;
+    g_mutex_unlock(&scheduler->lock);
+}
+
+void alarm_scheduler_add(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry, gint64 deadline)
+{
+    g_mutex_lock(&scheduler->lock);
+
+    if(alarm_scheduler_entry_is_queued(entry)) {
+        scheduler->queue_funcs->move(scheduler->queue, entry, deadline);
+    } else {
+        entry->deadline = deadline;
+        scheduler->queue_funcs->insert(scheduler->queue, entry, alarm_scheduler_clock_get_time(scheduler->clock));
+    }
+
+    // Only re-arm if the new deadline is earlier than what we're waiting for.
+    // A later one will be picked up when the timer fires.
+    if(!scheduler->frozen && (!scheduler->armed || deadline < scheduler->timer_deadline))
+        alarm_scheduler_arm(scheduler);
+
+    g_mutex_unlock(&scheduler->lock);
+}
+
+void alarm_scheduler_remove(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry)
+{
+    g_mutex_lock(&scheduler->lock);
+
+    // Leave the timer alone. If this was the earliest entry, the timer will
+    // wake up for nothing once and re-arm itself for the next one.
+    if(alarm_scheduler_entry_is_queued(entry))
+        scheduler->queue_funcs->remove(scheduler->queue, entry);
+
+    g_mutex_unlock(&scheduler->lock);
+}
+
+gboolean alarm_scheduler_is_queued(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry)
+{
+    g_mutex_lock(&scheduler->lock);
+    const gboolean queued = alarm_scheduler_entry_is_queued(entry);
+    g_mutex_unlock(&scheduler->lock);
+
+    return queued;
+}
+
+void alarm_scheduler_freeze(AlarmScheduler* scheduler)
+{
+    g_mutex_lock(&scheduler->lock);
+
+    if(scheduler->frozen++ == 0)
+        alarm_scheduler_arm(scheduler);
+
+    g_mutex_unlock(&scheduler->lock);
+}
+
+void alarm_scheduler_thaw(AlarmScheduler* scheduler)
+{
+    g_mutex_lock(&scheduler->lock);
+
+    if(scheduler->frozen == 0)
+        g_critical("AlarmScheduler: thawed more often than frozen");
+    else if(--scheduler->frozen == 0)
+        alarm_scheduler_arm(scheduler);
+
+    g_mutex_unlock(&scheduler->lock);
+}
+
+guint alarm_scheduler_get_size(AlarmScheduler* scheduler)
+{
+    g_mutex_lock(&scheduler->lock);
+    const guint size = scheduler->queue_funcs->size(scheduler->queue);
+    g_mutex_unlock(&scheduler->lock);
+
+    return size;
+}
+
+static void alarm_scheduler_add_entry(gpointer entry, gpointer entries)
+{
+    g_ptr_array_add(entries, entry);
+}
+
+GPtrArray* alarm_scheduler_get_entries(AlarmScheduler* scheduler)
+{
+    g_mutex_lock(&scheduler->lock);
+
+    GPtrArray* entries = g_ptr_array_sized_new(scheduler->queue_funcs->size(scheduler->queue));
+
+    scheduler->queue_funcs->foreach(scheduler->queue, alarm_scheduler_add_entry, entries);
+
+    g_mutex_unlock(&scheduler->lock);
+
+    return entries;
+}
+
+/*
+ * Arm the timer for the earliest deadline in the queue. Called with the
+ * lock held.
+ */
+static void alarm_scheduler_arm(AlarmScheduler* scheduler)
+{
+    // Will be done once the callbacks return
+    if(scheduler->dispatching)
+        return;
+
+    scheduler->armed = !scheduler->frozen && scheduler->queue_funcs->size(scheduler->queue) > 0;
+    scheduler->timer_deadline = scheduler->armed ? scheduler->queue_funcs->next(scheduler->queue) : 0;
+
+#ifdef HAVE_SYS_TIMERFD_H
+    if(scheduler->timer_fd >= 0) {
+        // An all-zero value disarms the timer
+        struct itimerspec spec = { 0 };
+        gint flags = TFD_TIMER_ABSTIME;
+
+        // Only valid for CLOCK_REALTIME
+        if(scheduler->clock == ALARM_SCHEDULER_CLOCK_REALTIME)
+            flags |= TFD_TIMER_CANCEL_ON_SET;
+
+        if(scheduler->armed) {
+            // Wake up on the exact deadline (or if the system time changes)
+            const gint64 deadline = MAX(scheduler->timer_deadline, 1);
+            spec.it_value.tv_sec = deadline / G_USEC_PER_SEC;
+            spec.it_value.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+        }
+
+        if(timerfd_settime(scheduler->timer_fd, flags, &spec, NULL) < 0)
+            g_critical("AlarmScheduler: Could not arm timer: %s", g_strerror(errno));
+
+        return;
+    }
+#endif
+
+    if(scheduler->timer_source) {
+        g_source_destroy(scheduler->timer_source);
+        g_clear_pointer(&scheduler->timer_source, g_source_unref);
+    }
+
+    if(!scheduler->armed)
+        return;
+
+    const gint64 deadline = scheduler->timer_deadline;
+    gint64 delay = deadline - alarm_scheduler_clock_get_time(scheduler->clock);
+
+    if(delay < 0)
+        delay = 0;
+    else if(delay > ALARM_SCHEDULER_MAX_SLEEP)
+        delay = ALARM_SCHEDULER_MAX_SLEEP;
+
+    // Round up so that we never wake up right before the deadline
+    const guint delay_ms = (delay + 999) / 1000;
+
+    scheduler->timer_source = g_timeout_source_new(delay_ms);
+    g_source_set_callback(scheduler->timer_source, alarm_scheduler_timeout, scheduler, NULL);
+    g_source_attach(scheduler->timer_source, scheduler->context);
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-scheduler.h -- Deadline-ordered alarm scheduler
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_SCHEDULER_H_
+#define ALARM_SCHEDULER_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AlarmScheduler AlarmScheduler;
+typedef struct _AlarmSchedulerEntry AlarmSchedulerEntry;
+
+typedef enum {
+    ALARM_SCHEDULER_CLOCK_REALTIME, /* Wall clock time, for alarms at a time of day */
+    ALARM_SCHEDULER_CLOCK_BOOTTIME, /* Monotonic time including suspend, for countdowns */
+} AlarmSchedulerClock;
+
+typedef enum {
+    ALARM_SCHEDULER_BACKEND_HEAP,  /* Binary heap, O(log n) */
+    ALARM_SCHEDULER_BACKEND_WHEEL, /* Hierarchical timing wheel, O(1) */
+} AlarmSchedulerBackend;
+
+/*
+ * A schedulable item. This is meant to be embedded in the object that
+ * is being scheduled, so that queueing never allocates.
+ */
+struct _AlarmSchedulerEntry {
+    gint64 deadline; /* Deadline in microseconds on the scheduler's clock */
+    guint index;     /* Position in the queue + 1, or 0 if not queued */
+    gpointer data;   /* Owner of the entry */
+
+    /* Slot list of the timing wheel */
+    AlarmSchedulerEntry* next;
+    AlarmSchedulerEntry* prev;
+};
+
+/*
+ * Called with all the entries that are due, ordered by deadline.
+ * The entries have already been removed from the queue and may be
+ * re-added from within the callback, or from another thread meanwhile.
+ * deadline is the earliest of their deadlines when they were collected.
+ */
+typedef void (*AlarmSchedulerFunc)(AlarmScheduler* scheduler, GPtrArray* due, gint64 deadline, gpointer data);
+
+/*
+ * Called when the system time has been changed (settimeofday, NTP step).
+ * Only available for ALARM_SCHEDULER_CLOCK_REALTIME with the timerfd backend.
+ */
+typedef void (*AlarmSchedulerClockFunc)(AlarmScheduler* scheduler, gpointer data);
+
+/*
+ * Takes a reference to the data of an entry, such as g_object_ref()
+ */
+typedef gpointer (*AlarmSchedulerRefFunc)(gpointer data);
+
+/*
+ * Backend used by alarm_scheduler_new(). Set once at startup.
+ */
+void alarm_scheduler_set_default_backend(AlarmSchedulerBackend backend);
+
+gboolean alarm_scheduler_backend_from_string(const gchar* str, AlarmSchedulerBackend* backend);
+
+AlarmScheduler* alarm_scheduler_new(AlarmSchedulerClock clock, AlarmSchedulerFunc func, gpointer data);
+
+AlarmScheduler* alarm_scheduler_new_full(AlarmSchedulerClock clock, AlarmSchedulerBackend backend, AlarmSchedulerFunc func, gpointer data);
+
+/*
+ * Dispatch from the given context instead of the default one. It may be
+ * run by another thread, the scheduler itself may be used from any thread.
+ */
+AlarmScheduler* alarm_scheduler_new_with_context(AlarmSchedulerClock clock, AlarmSchedulerBackend backend, GMainContext* context, AlarmSchedulerFunc func, gpointer data);
+
+void alarm_scheduler_free(AlarmScheduler* scheduler);
+
+void alarm_scheduler_set_clock_changed_func(AlarmScheduler* scheduler, AlarmSchedulerClockFunc func);
+
+/*
+ * Reference the data of due entries before the lock is dropped, and
+ * release it once the callback has returned. Needed when the entries
+ * may be removed and their owner freed from another thread meanwhile.
+ */
+void alarm_scheduler_set_data_funcs(AlarmScheduler* scheduler, AlarmSchedulerRefFunc ref_func, GDestroyNotify unref_func);
+
+/*
+ * Queue an entry, or move it if it is already queued.
+ */
+void alarm_scheduler_add(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry, gint64 deadline);
+
+void alarm_scheduler_remove(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry);
+
+/*
+ * Like alarm_scheduler_entry_is_queued(), for entries that are also
+ * used from the thread the scheduler is dispatched from.
+ */
+gboolean alarm_scheduler_is_queued(AlarmScheduler* scheduler, AlarmSchedulerEntry* entry);
+
+/*
+ * Stop dispatching and leave the timer disarmed until thawed, so that
+ * many entries can be added without re-arming it for each of them.
+ * Calls nest.
+ */
+void alarm_scheduler_freeze(AlarmScheduler* scheduler);
+
+void alarm_scheduler_thaw(AlarmScheduler* scheduler);
+
+guint alarm_scheduler_get_size(AlarmScheduler* scheduler);
+
+/*
+ * Current time in microseconds on the given clock
+ */
+gint64 alarm_scheduler_clock_get_time(AlarmSchedulerClock clock);
+
+/*
+ * Get a snapshot of the queued entries, in no particular order.
+ * Free with g_ptr_array_free().
+ */
+GPtrArray* alarm_scheduler_get_entries(AlarmScheduler* scheduler);
+
+static inline gboolean alarm_scheduler_entry_is_queued(const AlarmSchedulerEntry* entry)
+{
+    return entry->index > 0;
+}
+
+G_END_DECLS
+
+#endif /*ALARM_SCHEDULER_H_*/
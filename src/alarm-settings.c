@@ -90,14 +90,14 @@ static void alarm_settings_update_type(AlarmSettingsDialog* dialog)
 static void alarm_settings_update_label(AlarmSettingsDialog* dialog)
 {
     const gchar* entry_text = gtk_entry_get_text(GTK_ENTRY(dialog->label_entry));
-    if(g_strcmp0(entry_text, dialog->alarm->message) == 0) {
+    if(g_strcmp0(entry_text, alarm_get_message(dialog->alarm)) == 0) {
         // No change
         return;
     }
 
     g_debug("AlarmSettingsDialog: update_label()");
 
-    g_object_set(dialog->label_entry, "text", dialog->alarm->message, NULL);
+    g_object_set(dialog->label_entry, "text", alarm_get_message(dialog->alarm), NULL);
 }
 
 static void alarm_settings_update_time(AlarmSettingsDialog* dialog)
@@ -203,7 +203,7 @@ static void alarm_settings_update_sound(AlarmSettingsDialog* dialog)
     pos = gtk_combo_box_get_active(GTK_COMBO_BOX(dialog->notify_sound_combo));
     item = g_list_nth_data(dialog->applet->sounds, pos);
 
-    if(item && g_strcmp0(item->data, dialog->alarm->sound_file) == 0) {
+    if(item && g_strcmp0(item->data, alarm_get_sound_file(dialog->alarm)) == 0) {
         // No change
         return;
     }
@@ -216,7 +216,7 @@ static void alarm_settings_update_sound(AlarmSettingsDialog* dialog)
     // Look for the selected sound file
     for(l = dialog->applet->sounds, pos = 0; l != NULL; l = l->next, pos++) {
         item = (AlarmListEntry*)l->data;
-        if(strcmp(item->data, dialog->alarm->sound_file) == 0) {
+        if(strcmp(item->data, alarm_get_sound_file(dialog->alarm)) == 0) {
             // Match!
             gtk_combo_box_set_active(GTK_COMBO_BOX(dialog->notify_sound_combo), pos);
             break;
@@ -246,7 +246,7 @@ static void alarm_settings_update_app(AlarmSettingsDialog* dialog)
     pos = gtk_combo_box_get_active(GTK_COMBO_BOX(dialog->notify_app_combo));
     item = g_list_nth_data(dialog->applet->apps, pos);
 
-    if(item && g_strcmp0(item->data, dialog->alarm->command) == 0) {
+    if(item && g_strcmp0(item->data, alarm_get_command(dialog->alarm)) == 0) {
         // No change
         return;
     }
@@ -254,7 +254,7 @@ static void alarm_settings_update_app(AlarmSettingsDialog* dialog)
     g_debug("AlarmSettingsDialog: update_app()");
 
     //	g_debug ("alarm_settings_update_app (%p): app_combo: %p, applet: %p, apps: %p", dialog, dialog->notify_app_combo, dialog->applet,
-    // dialog->applet->apps); 	g_debug ("alarm_settings_update_app setting entry to %s", dialog->alarm->command);
+    // dialog->applet->apps); 	g_debug ("alarm_settings_update_app setting entry to %s", alarm_get_command(dialog->alarm));
 
     /* Fill apps list */
     fill_combo_box(GTK_COMBO_BOX(dialog->notify_app_combo), dialog->applet->apps, _("Custom command..."));
@@ -263,7 +263,7 @@ static void alarm_settings_update_app(AlarmSettingsDialog* dialog)
     len = g_list_length(dialog->applet->apps);
     for(l = dialog->applet->apps, pos = 0; l != NULL; l = l->next, pos++) {
         item = (AlarmListEntry*)l->data;
-        if(strcmp(item->data, dialog->alarm->command) == 0) {
+        if(strcmp(item->data, alarm_get_command(dialog->alarm)) == 0) {
             // Match!
             break;
         }
@@ -289,12 +289,12 @@ static void alarm_settings_update_app_command(AlarmSettingsDialog* dialog)
 {
     g_debug("AlarmSettingsDialog: update_app_command()");
 
-    if(g_strcmp0(dialog->alarm->command, gtk_entry_get_text(GTK_ENTRY(dialog->notify_app_command_entry))) == 0) {
+    if(g_strcmp0(alarm_get_command(dialog->alarm), gtk_entry_get_text(GTK_ENTRY(dialog->notify_app_command_entry))) == 0) {
         // No change
         return;
     }
 
-    g_object_set(dialog->notify_app_command_entry, "text", dialog->alarm->command, NULL);
+    g_object_set(dialog->notify_app_command_entry, "text", alarm_get_command(dialog->alarm), NULL);
 }
 
 static void alarm_settings_update(AlarmSettingsDialog* dialog)
@@ -379,7 +379,7 @@ static void open_sound_file_chooser(AlarmSettingsDialog* dialog)
 
     chooser = gtk_file_chooser_dialog_new(_("Select sound file..."), GTK_WINDOW(dialog->dialog), GTK_FILE_CHOOSER_ACTION_OPEN, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Open"), GTK_RESPONSE_ACCEPT, NULL);
 
-    gtk_file_chooser_set_uri(GTK_FILE_CHOOSER(chooser), dialog->alarm->sound_file);
+    gtk_file_chooser_set_uri(GTK_FILE_CHOOSER(chooser), alarm_get_sound_file(dialog->alarm));
 
     if(gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
         gchar* uri;
@@ -743,7 +743,7 @@ void alarm_settings_sound_preview(GtkButton* button, gpointer data)
     } else {
         // Start preview player
         if(dialog->player == NULL) {
-            dialog->player = media_player_new(dialog->alarm->sound_file, dialog->alarm->sound_loop, preview_player_state_cb, dialog, media_player_error_cb,
+            dialog->player = media_player_new(alarm_get_sound_file(dialog->alarm), dialog->alarm->sound_loop, preview_player_state_cb, dialog, media_player_error_cb,
                                               dialog->dialog);
             if(dialog->player == NULL) {
                 // Unable to create player
@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-storage.c -- Packed storage of the alarm settings
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <stdlib.h>
+
+#include "alarm-storage.h"
+#include "alarm-log.h"
+
+#define ALARM_STORAGE_KEY "alarms-packed"
+
+static struct {
+    GSettings* settings;
+    gboolean packed;
+    GHashTable* entries;   // id -> a{sv}
+    gboolean dirty;        // The entries changed since they were written
+    GVariant* written;     // What was last written to the key, to tell its echo apart
+    AlarmStorageLookupFunc lookup_func;
+    gpointer lookup_data;
+    GHashTable* unapplied; // Delayed alarm settings with changes, see alarm_storage_delay()
+    guint flush_id;
+} alarm_storage;
+
+/*
+ * Decode all alarms of the packed key in one pass. The entries keep the
+ * value alive.
+ */
+static GHashTable* alarm_storage_decode(GVariant* value)
+{
+    GHashTable* entries = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_variant_unref);
+    GVariant* props;
+    GVariantIter iter;
+    guint32 id;
+
+    g_variant_iter_init(&iter, value);
+    while(g_variant_iter_next(&iter, "(u@a{sv})", &id, &props))
+        g_hash_table_insert(entries, GUINT_TO_POINTER(id), props);
+
+    return entries;
+}
+
+static Alarm* alarm_storage_lookup(gpointer id)
+{
+    return alarm_storage.lookup_func ? alarm_storage.lookup_func(GPOINTER_TO_UINT(id), alarm_storage.lookup_data) : NULL;
+}
+
+/*
+ * The key was changed by someone else. Take over the entries that differ
+ * from ours, and set them on the live alarms.
+ */
+static void alarm_storage_changed(GSettings* settings, gchar* key, gpointer data)
+{
+    GVariant* value = g_settings_get_value(settings, ALARM_STORAGE_KEY);
+    GHashTable* entries;
+    GHashTableIter iter;
+    gpointer id;
+    gpointer props;
+
+    // Our own write coming back
+    if(alarm_storage.written && g_variant_equal(value, alarm_storage.written)) {
+        g_variant_unref(value);
+        return;
+    }
+
+    entries = alarm_storage_decode(value);
+    g_variant_unref(value);
+
+    // Coming back to what we wrote is a change again
+    g_clear_pointer(&alarm_storage.written, g_variant_unref);
+
+    alarm_log_debug(ALARM_LOG_STORAGE, "AlarmStorage: key changed, %u packed alarms", g_hash_table_size(entries));
+
+    // Alarms that went away are deleted through the alarm list, unless
+    // they are new here and not written yet
+    g_hash_table_iter_init(&iter, alarm_storage.entries);
+    while(g_hash_table_iter_next(&iter, &id, NULL)) {
+        if(!g_hash_table_contains(entries, id) && !alarm_storage_lookup(id))
+            g_hash_table_iter_remove(&iter);
+    }
+
+    g_hash_table_iter_init(&iter, entries);
+    while(g_hash_table_iter_next(&iter, &id, &props)) {
+        GVariant* old = g_hash_table_lookup(alarm_storage.entries, id);
+        Alarm* alarm;
+
+        if(old && g_variant_equal(old, props))
+            continue;
+
+        g_hash_table_insert(alarm_storage.entries, id, g_variant_ref(props));
+
+        // With path storage, live alarms only read the key when loaded
+        alarm = alarm_storage.packed ? alarm_storage_lookup(id) : NULL;
+        if(!alarm)
+            continue;
+
+        // Saving back from the notify finds the same entry, and writes nothing
+        alarm_storage_load(alarm, FALSE);
+        if(alarm_is_cold_loaded(alarm))
+            alarm_storage_load(alarm, TRUE);
+    }
+
+    g_hash_table_unref(entries);
+}
+
+void alarm_storage_init(GSettings* settings)
+{
+    GVariant* value;
+
+    g_return_if_fail(alarm_storage.settings == NULL);
+
+    alarm_storage.settings = g_object_ref(settings);
+    alarm_storage.packed = g_settings_get_enum(settings, "storage") == ALARM_STORAGE_PACKED;
+
+    value = g_settings_get_value(settings, ALARM_STORAGE_KEY);
+    alarm_storage.entries = alarm_storage_decode(value);
+    g_variant_unref(value);
+
+    g_signal_connect(settings, "changed::" ALARM_STORAGE_KEY, G_CALLBACK(alarm_storage_changed), NULL);
+
+    alarm_log_debug(ALARM_LOG_STORAGE, "AlarmStorage: %s, %u packed alarms", alarm_storage.packed ? "packed" : "paths", g_hash_table_size(alarm_storage.entries));
+}
+
+void alarm_storage_set_lookup_func(AlarmStorageLookupFunc func, gpointer data)
+{
+    alarm_storage.lookup_func = func;
+    alarm_storage.lookup_data = data;
+}
+
+gboolean alarm_storage_is_packed(void)
+{
+    return alarm_storage.packed;
+}
+
+static GVariant* alarm_storage_value_to_variant(const GValue* value)
+{
+    switch(G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))) {
+    case G_TYPE_BOOLEAN:
+        return g_variant_new_boolean(g_value_get_boolean(value));
+    case G_TYPE_INT64:
+        return g_variant_new_int64(g_value_get_int64(value));
+    case G_TYPE_STRING:
+        return g_variant_new_string(g_value_get_string(value) ? g_value_get_string(value) : "");
+    case G_TYPE_ENUM:
+        return g_variant_new_int32(g_value_get_enum(value));
+    case G_TYPE_FLAGS:
+        return g_variant_new_uint32(g_value_get_flags(value));
+    default:
+        return NULL;
+    }
+}
+
+static gboolean alarm_storage_variant_to_value(GVariant* variant, GValue* value)
+{
+    switch(G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))) {
+    case G_TYPE_BOOLEAN:
+        if(!g_variant_is_of_type(variant, G_VARIANT_TYPE_BOOLEAN))
+            return FALSE;
+        g_value_set_boolean(value, g_variant_get_boolean(variant));
+        return TRUE;
+    case G_TYPE_INT64:
+        if(!g_variant_is_of_type(variant, G_VARIANT_TYPE_INT64))
+            return FALSE;
+        g_value_set_int64(value, g_variant_get_int64(variant));
+        return TRUE;
+    case G_TYPE_STRING:
+        if(!g_variant_is_of_type(variant, G_VARIANT_TYPE_STRING))
+            return FALSE;
+        g_value_set_string(value, g_variant_get_string(variant, NULL));
+        return TRUE;
+    case G_TYPE_ENUM:
+        if(!g_variant_is_of_type(variant, G_VARIANT_TYPE_INT32))
+            return FALSE;
+        g_value_set_enum(value, g_variant_get_int32(variant));
+        return TRUE;
+    case G_TYPE_FLAGS:
+        if(!g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32))
+            return FALSE;
+        g_value_set_flags(value, g_variant_get_uint32(variant));
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ * Stored properties of an alarm as a{sv}. Cold properties that haven't
+ * been read yet are kept from old.
+ */
+static GVariant* alarm_storage_encode(Alarm* alarm, GVariant* old)
+{
+    const gchar* const* names = alarm_get_stored_properties();
+    GObjectClass* klass = G_OBJECT_GET_CLASS(alarm);
+    GVariantBuilder builder;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    for(guint i = 0; names[i]; i++) {
+        GParamSpec* pspec = g_object_class_find_property(klass, names[i]);
+        GValue value = G_VALUE_INIT;
+        GVariant* variant;
+
+        if(alarm_property_is_cold(names[i]) && !alarm_is_cold_loaded(alarm)) {
+            variant = old ? g_variant_lookup_value(old, names[i], NULL) : NULL;
+            if(variant) {
+                g_variant_builder_add(&builder, "{sv}", names[i], variant);
+                g_variant_unref(variant);
+            }
+            continue;
+        }
+
+        g_value_init(&value, pspec->value_type);
+        g_object_get_property(G_OBJECT(alarm), names[i], &value);
+
+        variant = alarm_storage_value_to_variant(&value);
+        if(variant)
+            g_variant_builder_add(&builder, "{sv}", names[i], variant);
+
+        g_value_unset(&value);
+    }
+
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+static gint alarm_storage_id_compare(gconstpointer a, gconstpointer b)
+{
+    const guint id1 = GPOINTER_TO_UINT(*(gpointer*)a);
+    const guint id2 = GPOINTER_TO_UINT(*(gpointer*)b);
+
+    return (id1 > id2) - (id1 < id2);
+}
+
+static void alarm_storage_write(void)
+{
+    GVariantBuilder builder;
+    guint n;
+    gpointer* ids = g_hash_table_get_keys_as_array(alarm_storage.entries, &n);
+
+    // In order of id, to keep the key readable
+    qsort(ids, n, sizeof(gpointer), alarm_storage_id_compare);
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ua{sv})"));
+
+    for(guint i = 0; i < n; i++) {
+        GVariant* props = g_hash_table_lookup(alarm_storage.entries, ids[i]);
+        g_variant_builder_add(&builder, "(u@a{sv})", GPOINTER_TO_UINT(ids[i]), props);
+    }
+
+    alarm_log_debug(ALARM_LOG_STORAGE, "AlarmStorage: writing %u packed alarms", n);
+
+    g_clear_pointer(&alarm_storage.written, g_variant_unref);
+    alarm_storage.written = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+    g_settings_set_value(alarm_storage.settings, ALARM_STORAGE_KEY, alarm_storage.written);
+
+    g_free(ids);
+}
+
+static void alarm_storage_write_pending(void)
+{
+    GHashTableIter iter;
+    gpointer key;
+
+    if(alarm_storage.dirty) {
+        alarm_storage.dirty = FALSE;
+        alarm_storage_write();
+    }
+
+    if(!alarm_storage.unapplied)
+        return;
+
+    alarm_log_debug(ALARM_LOG_STORAGE, "AlarmStorage: applying %u alarm paths", g_hash_table_size(alarm_storage.unapplied));
+
+    // One transaction for each alarm's path
+    g_hash_table_iter_init(&iter, alarm_storage.unapplied);
+    while(g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_settings_apply(G_SETTINGS(key));
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
+static gboolean alarm_storage_flush_idle(gpointer data)
+{
+    alarm_storage.flush_id = 0;
+    alarm_storage_write_pending();
+
+    return G_SOURCE_REMOVE;
+}
+
+static void alarm_storage_queue_flush(void)
+{
+    if(!alarm_storage.flush_id)
+        alarm_storage.flush_id = g_idle_add(alarm_storage_flush_idle, NULL);
+}
+
+void alarm_storage_flush(void)
+{
+    if(!alarm_storage.flush_id)
+        return;
+
+    g_source_remove(alarm_storage.flush_id);
+    alarm_storage.flush_id = 0;
+
+    alarm_storage_write_pending();
+
+    // Don't leave it to a main loop that may be gone
+    g_settings_sync();
+}
+
+gboolean alarm_storage_load(Alarm* alarm, gboolean cold)
+{
+    const gchar* const* names = alarm_get_stored_properties();
+    GObjectClass* klass = G_OBJECT_GET_CLASS(alarm);
+    GVariant* props;
+    GVariant* variant;
+    GVariantIter iter;
+    const gchar* name;
+
+    if(!alarm_storage.entries)
+        return FALSE;
+
+    props = g_hash_table_lookup(alarm_storage.entries, GUINT_TO_POINTER(alarm->id));
+    if(!props)
+        return FALSE;
+
+    g_object_freeze_notify(G_OBJECT(alarm));
+
+    g_variant_iter_init(&iter, props);
+    while(g_variant_iter_next(&iter, "{&sv}", &name, &variant)) {
+        GParamSpec* pspec = g_object_class_find_property(klass, name);
+        GValue value = G_VALUE_INIT;
+
+        if(pspec && g_strv_contains(names, name) && alarm_property_is_cold(name) == cold) {
+            g_value_init(&value, pspec->value_type);
+
+            if(alarm_storage_variant_to_value(variant, &value))
+                g_object_set_property(G_OBJECT(alarm), name, &value);
+            else
+                g_warning("Alarm(%p) #%d: Invalid stored value for %s", alarm, alarm->id, name);
+
+            g_value_unset(&value);
+        }
+
+        g_variant_unref(variant);
+    }
+
+    g_object_thaw_notify(G_OBJECT(alarm));
+
+    return TRUE;
+}
+
+void alarm_storage_save(Alarm* alarm)
+{
+    GVariant* props;
+    GVariant* old;
+
+    if(!alarm_storage.packed)
+        return;
+
+    old = g_hash_table_lookup(alarm_storage.entries, GUINT_TO_POINTER(alarm->id));
+    props = alarm_storage_encode(alarm, old);
+
+    if(old && g_variant_equal(old, props)) {
+        g_variant_unref(props);
+        return;
+    }
+
+    g_hash_table_insert(alarm_storage.entries, GUINT_TO_POINTER(alarm->id), props);
+    alarm_storage.dirty = TRUE;
+    alarm_storage_queue_flush();
+}
+
+void alarm_storage_remove(guint id)
+{
+    if(alarm_storage.entries && g_hash_table_remove(alarm_storage.entries, GUINT_TO_POINTER(id))) {
+        alarm_storage.dirty = TRUE;
+        alarm_storage_queue_flush();
+    }
+}
+
+static void alarm_storage_unapplied_changed(GSettings* settings, GParamSpec* pspec, gpointer data)
+{
+    if(!g_settings_get_has_unapplied(settings))
+        return;
+
+    if(!alarm_storage.unapplied)
+        alarm_storage.unapplied = g_hash_table_new_full(NULL, NULL, g_object_unref, NULL);
+
+    // Keep it until applied, even if the alarm goes away
+    if(!g_hash_table_contains(alarm_storage.unapplied, settings))
+        g_hash_table_add(alarm_storage.unapplied, g_object_ref(settings));
+
+    alarm_storage_queue_flush();
+}
+
+void alarm_storage_apply(GSettings* settings)
+{
+    g_settings_apply(settings);
+
+    if(alarm_storage.unapplied)
+        g_hash_table_remove(alarm_storage.unapplied, settings);
+}
+
+void alarm_storage_delay(GSettings* settings)
+{
+    g_settings_delay(settings);
+    g_signal_connect(settings, "notify::has-unapplied", G_CALLBACK(alarm_storage_unapplied_changed), NULL);
+}
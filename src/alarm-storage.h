@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-storage.h -- Packed storage of the alarm settings
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_STORAGE_H_
+#define ALARM_STORAGE_H_
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "alarm.h"
+
+G_BEGIN_DECLS
+
+/*
+ * By default every alarm has a GSettings object of its own, at its own
+ * path. With packed storage all alarms are kept in the "alarms-packed"
+ * key instead, as an array of (id, {property: value}). It is decoded at
+ * startup and again whenever someone else changes it, and changes are
+ * written back in one go from an idle callback.
+ *
+ * Alarms missing from the packed key are read once from their own path,
+ * so that existing alarms migrate by themselves. Going back, the packed
+ * values are written to the paths as the alarms are loaded.
+ *
+ * Cold properties stay in the decoded key until first used.
+ *
+ * The settings at the alarms' own paths are delayed as well. What changes
+ * during one main loop iteration is applied from the same idle callback,
+ * one transaction per alarm.
+ */
+
+/*
+ * Read the storage type and the packed key. Call before any alarm is
+ * created.
+ */
+void alarm_storage_init(GSettings* settings);
+
+gboolean alarm_storage_is_packed(void);
+
+/*
+ * Find the live alarm with the given id, or NULL. Alarms changed in the
+ * packed key by someone else are looked up through this to be updated.
+ */
+typedef Alarm* (*AlarmStorageLookupFunc)(guint id, gpointer data);
+
+void alarm_storage_set_lookup_func(AlarmStorageLookupFunc func, gpointer data);
+
+/*
+ * Set either the cold or the other properties of an alarm from the packed
+ * key. Returns FALSE if the alarm is not in there.
+ */
+gboolean alarm_storage_load(Alarm* alarm, gboolean cold);
+
+/*
+ * Store the current properties of an alarm
+ */
+void alarm_storage_save(Alarm* alarm);
+
+void alarm_storage_remove(guint id);
+
+/*
+ * Hold back the changes to the settings of an alarm's path until idle
+ */
+void alarm_storage_delay(GSettings* settings);
+
+/*
+ * Apply the changes held back for one alarm's path now, before its id is
+ * given to another alarm
+ */
+void alarm_storage_apply(GSettings* settings);
+
+/*
+ * Write pending changes now, instead of when idle. Call before quitting.
+ */
+void alarm_storage_flush(void);
+
+G_END_DECLS
+
+#endif /*ALARM_STORAGE_H_*/
@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-store.c -- Set of loaded alarms, indexed by id
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <string.h>
+
+#include "alarm-store.h"
+
+#define ALARM_STORE_WORD_BITS 64
+
+/* Ids beyond this many words are not tracked, as they are never allocated */
+#define ALARM_STORE_MAX_WORDS (1 << 14)
+
+static inline guint alarm_store_ctz(guint64 bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    guint n = 0;
+
+    while(!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+/* Bit set of a single one of AlarmStoreFlags */
+#define ALARM_STORE_FLAG_BITS(store, flag) ((store)->flags[alarm_store_ctz(flag)])
+
+static inline gboolean alarm_store_bit_get(const guint64* bits, guint i)
+{
+    return (bits[i / ALARM_STORE_WORD_BITS] >> (i % ALARM_STORE_WORD_BITS)) & 1;
+}
+
+static inline void alarm_store_bit_set(guint64* bits, guint i, gboolean value)
+{
+    const guint64 bit = G_GUINT64_CONSTANT(1) << (i % ALARM_STORE_WORD_BITS);
+
+    if(value)
+        bits[i / ALARM_STORE_WORD_BITS] |= bit;
+    else
+        bits[i / ALARM_STORE_WORD_BITS] &= ~bit;
+}
+
+static void alarm_store_slot_set(AlarmStore* store, guint slot, Alarm* alarm, AlarmDirtyFlags dirty)
+{
+    store->timestamps[slot] = alarm->timestamp;
+    store->dirty[slot] |= dirty;
+    alarm_store_bit_set(ALARM_STORE_FLAG_BITS(store, ALARM_STORE_ACTIVE), slot, alarm->active);
+    alarm_store_bit_set(ALARM_STORE_FLAG_BITS(store, ALARM_STORE_TRIGGERED), slot, alarm->triggered);
+    alarm_store_bit_set(ALARM_STORE_FLAG_BITS(store, ALARM_STORE_DIRTY), slot, store->dirty[slot] != 0);
+}
+
+static void alarm_store_reserve(AlarmStore* store, guint len)
+{
+    if(len <= store->capacity)
+        return;
+
+    const guint capacity = MAX(store->capacity * 2, ALARM_STORE_WORD_BITS);
+    const guint old_words = store->capacity / ALARM_STORE_WORD_BITS;
+    const guint n_words = capacity / ALARM_STORE_WORD_BITS;
+
+    store->timestamps = g_renew(gint64, store->timestamps, capacity);
+    store->dirty = g_renew(guint32, store->dirty, capacity);
+
+    for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++) {
+        store->flags[f] = g_renew(guint64, store->flags[f], n_words);
+        memset(store->flags[f] + old_words, 0, (n_words - old_words) * sizeof(guint64));
+    }
+
+    store->capacity = capacity;
+}
+
+static void alarm_store_id_set(AlarmStore* store, guint id, gboolean used)
+{
+    const guint word = id / ALARM_STORE_WORD_BITS;
+    const guint64 bit = G_GUINT64_CONSTANT(1) << (id % ALARM_STORE_WORD_BITS);
+
+    if(word >= ALARM_STORE_MAX_WORDS)
+        return;
+
+    if(!used) {
+        if(word < store->n_words)
+            store->ids[word] &= ~bit;
+        store->free_word = MIN(store->free_word, word);
+        return;
+    }
+
+    if(word >= store->n_words) {
+        const guint n_words = MIN(MAX(word + 1, store->n_words * 2), ALARM_STORE_MAX_WORDS);
+
+        store->ids = g_renew(guint64, store->ids, n_words);
+        memset(store->ids + store->n_words, 0, (n_words - store->n_words) * sizeof(guint64));
+        store->n_words = n_words;
+    }
+
+    store->ids[word] |= bit;
+}
+
+AlarmStore* alarm_store_new(void)
+{
+    AlarmStore* store = g_new(AlarmStore, 1);
+
+    store->alarms = g_ptr_array_new();
+    store->slots = g_hash_table_new(NULL, NULL);
+    store->ids = NULL;
+    store->n_words = 0;
+    store->free_word = 0;
+    store->timestamps = NULL;
+    store->dirty = NULL;
+    store->capacity = 0;
+
+    for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++)
+        store->flags[f] = NULL;
+
+    return store;
+}
+
+void alarm_store_free(AlarmStore* store)
+{
+    for(guint i = 0; i < store->alarms->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(store->alarms, i));
+
+        alarm->store = NULL;
+        g_object_unref(alarm);
+    }
+
+    g_ptr_array_free(store->alarms, TRUE);
+    g_hash_table_destroy(store->slots);
+    g_free(store->ids);
+    g_free(store->timestamps);
+    g_free(store->dirty);
+
+    for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++)
+        g_free(store->flags[f]);
+    g_free(store);
+}
+
+void alarm_store_add(AlarmStore* store, Alarm* alarm)
+{
+    g_return_if_fail(!g_hash_table_contains(store->slots, GUINT_TO_POINTER(alarm->id)));
+
+    const guint slot = store->alarms->len;
+
+    alarm_store_reserve(store, slot + 1);
+    store->dirty[slot] = 0;
+    alarm_store_slot_set(store, slot, alarm, ALARM_DIRTY_ALL);
+
+    g_hash_table_insert(store->slots, GUINT_TO_POINTER(alarm->id), GUINT_TO_POINTER(slot));
+    g_ptr_array_add(store->alarms, alarm);
+    alarm_store_id_set(store, alarm->id, TRUE);
+    alarm->store = store;
+}
+
+gboolean alarm_store_remove(AlarmStore* store, Alarm* alarm)
+{
+    gpointer value;
+
+    if(!g_hash_table_lookup_extended(store->slots, GUINT_TO_POINTER(alarm->id), NULL, &value))
+        return FALSE;
+
+    const guint slot = GPOINTER_TO_UINT(value);
+    const guint last = store->alarms->len - 1;
+
+    g_return_val_if_fail(g_ptr_array_index(store->alarms, slot) == alarm, FALSE);
+
+    g_hash_table_remove(store->slots, GUINT_TO_POINTER(alarm->id));
+    g_ptr_array_remove_index_fast(store->alarms, slot);
+    alarm_store_id_set(store, alarm->id, FALSE);
+    alarm->store = NULL;
+
+    // The last alarm has taken over the slot
+    if(slot < last) {
+        Alarm* moved = ALARM(g_ptr_array_index(store->alarms, slot));
+        g_hash_table_insert(store->slots, GUINT_TO_POINTER(moved->id), GUINT_TO_POINTER(slot));
+
+        store->timestamps[slot] = store->timestamps[last];
+        store->dirty[slot] = store->dirty[last];
+        for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++)
+            alarm_store_bit_set(store->flags[f], slot, alarm_store_bit_get(store->flags[f], last));
+    }
+
+    // Keep the bits past the end clear for the scans
+    store->dirty[last] = 0;
+    for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++)
+        alarm_store_bit_set(store->flags[f], last, FALSE);
+
+    return TRUE;
+}
+
+Alarm* alarm_store_lookup(AlarmStore* store, guint id)
+{
+    gpointer value;
+
+    if(!g_hash_table_lookup_extended(store->slots, GUINT_TO_POINTER(id), NULL, &value))
+        return NULL;
+
+    return ALARM(g_ptr_array_index(store->alarms, GPOINTER_TO_UINT(value)));
+}
+
+guint alarm_store_gen_id(AlarmStore* store)
+{
+    guint word = store->free_word;
+
+    while(word < store->n_words && store->ids[word] == G_MAXUINT64)
+        word++;
+
+    store->free_word = word;
+
+    if(word < store->n_words)
+        return word * ALARM_STORE_WORD_BITS + alarm_store_ctz(~store->ids[word]);
+
+    // Every tracked id is in use, so the first untracked one is free
+    // unless the bitset is at its limit
+    guint id = word * ALARM_STORE_WORD_BITS;
+
+    while(alarm_store_lookup(store, id))
+        id++;
+
+    return id;
+}
+
+void alarm_store_update(AlarmStore* store, Alarm* alarm, AlarmDirtyFlags dirty)
+{
+    gpointer value;
+
+    if(!g_hash_table_lookup_extended(store->slots, GUINT_TO_POINTER(alarm->id), NULL, &value))
+        return;
+
+    alarm_store_slot_set(store, GPOINTER_TO_UINT(value), alarm, dirty);
+}
+
+AlarmDirtyFlags alarm_store_take_dirty(AlarmStore* store, Alarm* alarm)
+{
+    gpointer value;
+
+    if(!g_hash_table_lookup_extended(store->slots, GUINT_TO_POINTER(alarm->id), NULL, &value))
+        return ALARM_DIRTY_ALL;
+
+    const guint slot = GPOINTER_TO_UINT(value);
+    const AlarmDirtyFlags dirty = store->dirty[slot];
+
+    store->dirty[slot] = 0;
+    alarm_store_bit_set(ALARM_STORE_FLAG_BITS(store, ALARM_STORE_DIRTY), slot, FALSE);
+
+    return dirty;
+}
+
+guint alarm_store_next(AlarmStore* store, AlarmStoreFlags flags, guint from)
+{
+    const guint len = store->alarms->len;
+
+    for(guint word = from / ALARM_STORE_WORD_BITS; word * ALARM_STORE_WORD_BITS < len; word++) {
+        guint64 bits = 0;
+
+        for(guint f = 0; f < ALARM_STORE_N_FLAGS; f++) {
+            if(flags & (1 << f))
+                bits |= store->flags[f][word];
+        }
+
+        // Skip the slots before from in its word
+        if(word == from / ALARM_STORE_WORD_BITS)
+            bits &= G_MAXUINT64 << (from % ALARM_STORE_WORD_BITS);
+
+        if(bits)
+            return word * ALARM_STORE_WORD_BITS + alarm_store_ctz(bits);
+    }
+
+    return len;
+}
+
+Alarm* alarm_store_get_next_active(AlarmStore* store)
+{
+    const guint len = store->alarms->len;
+    guint next = len;
+
+    for(guint word = 0; word * ALARM_STORE_WORD_BITS < len; word++) {
+        guint64 bits = ALARM_STORE_FLAG_BITS(store, ALARM_STORE_ACTIVE)[word];
+
+        while(bits) {
+            const guint slot = word * ALARM_STORE_WORD_BITS + alarm_store_ctz(bits);
+
+            if(next == len || store->timestamps[slot] < store->timestamps[next])
+                next = slot;
+
+            bits &= bits - 1;
+        }
+    }
+
+    return next < len ? alarm_store_index(store, next) : NULL;
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-store.h -- Set of loaded alarms, indexed by id
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_STORE_H_
+#define ALARM_STORE_H_
+
+#include <glib.h>
+
+#include "alarm.h"
+
+G_BEGIN_DECLS
+
+/*
+ * The alarms are kept densely in an array, in no particular order, and
+ * indexed by id. Removing an alarm moves the last one into its slot, so
+ * loops that remove while iterating should walk backwards.
+ *
+ * The store owns one reference to each alarm. Adding takes over the
+ * caller's reference, and removing hands it back.
+ *
+ * The ids in use are also tracked in a bitset, from which new ids are
+ * allocated.
+ *
+ * The timestamps and flags that are checked on every tick are mirrored
+ * per slot in plain arrays, so that those scans don't have to touch the
+ * alarms themselves. Alarms keep them up to date through
+ * alarm_store_update() whenever a property is set, which also collects
+ * the dirty properties of each alarm.
+ */
+typedef enum {
+    ALARM_STORE_ACTIVE    = 1 << 0,
+    ALARM_STORE_TRIGGERED = 1 << 1,
+    ALARM_STORE_DIRTY     = 1 << 2, /* Has dirty properties, see alarm_store_take_dirty() */
+} AlarmStoreFlags;
+
+#define ALARM_STORE_N_FLAGS 3
+
+typedef struct _AlarmStore AlarmStore;
+
+struct _AlarmStore {
+    GPtrArray* alarms;
+    GHashTable* slots; /* id -> slot in alarms */
+
+    guint64* ids;    /* Bit set for every id in use */
+    guint n_words;   /* Length of ids */
+    guint free_word; /* All ids before this word are in use */
+
+    gint64* timestamps;                   /* Per slot */
+    guint64* flags[ALARM_STORE_N_FLAGS];  /* Bit set per slot, one for each of AlarmStoreFlags */
+    guint32* dirty;                       /* AlarmDirtyFlags per slot */
+    guint capacity;                       /* Slots allocated, a multiple of 64 */
+};
+
+AlarmStore* alarm_store_new(void);
+
+void alarm_store_free(AlarmStore* store);
+
+void alarm_store_add(AlarmStore* store, Alarm* alarm);
+
+gboolean alarm_store_remove(AlarmStore* store, Alarm* alarm);
+
+Alarm* alarm_store_lookup(AlarmStore* store, guint id);
+
+/*
+ * Lowest id that is not in use
+ */
+guint alarm_store_gen_id(AlarmStore* store);
+
+/*
+ * Copy the timestamp and flags of an alarm into its slot, and add to its
+ * dirty properties
+ */
+void alarm_store_update(AlarmStore* store, Alarm* alarm, AlarmDirtyFlags dirty);
+
+/*
+ * Dirty properties of an alarm since the last call, all of them for a newly
+ * added alarm
+ */
+AlarmDirtyFlags alarm_store_take_dirty(AlarmStore* store, Alarm* alarm);
+
+/*
+ * First slot from the given one on with any of the flags set, or the size
+ * of the store if there is none. Slots can be cleared while iterating.
+ */
+guint alarm_store_next(AlarmStore* store, AlarmStoreFlags flags, guint from);
+
+/*
+ * Active alarm with the earliest timestamp, or NULL
+ */
+Alarm* alarm_store_get_next_active(AlarmStore* store);
+
+static inline guint alarm_store_get_size(AlarmStore* store)
+{
+    return store->alarms->len;
+}
+
+static inline Alarm* alarm_store_index(AlarmStore* store, guint i)
+{
+    return ALARM(g_ptr_array_index(store->alarms, i));
+}
+
+G_END_DECLS
+
+#endif /*ALARM_STORE_H_*/
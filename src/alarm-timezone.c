@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-timezone.c -- Cached local time zone
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <gio/gio.h>
+
+#include "alarm-timezone.h"
+
+/*
+ * tzset() and mktime() may stat /etc/localtime and take the libc time zone
+ * lock on every call. Instead, the UTC offsets of the local time zone are
+ * looked up once for about a year ahead, so that converting between local
+ * time and UTC is a scan over a couple of segments.
+ *
+ * The cache stays around the current time. Times outside of it, such as
+ * far off cron matches, are looked up in the time zone directly.
+ *
+ * The cache is dropped when TZ changes or /etc/localtime is replaced.
+ */
+
+#define ALARM_TIMEZONE_LOCALTIME "/etc/localtime"
+
+/* Range of the cached offsets around the current time */
+#define ALARM_TIMEZONE_RANGE_BEFORE (G_GINT64_CONSTANT(2) * 24 * 60 * 60)
+#define ALARM_TIMEZONE_RANGE_AFTER  (G_GINT64_CONSTANT(400) * 24 * 60 * 60)
+
+/* Transitions are assumed to be at least this far apart */
+#define ALARM_TIMEZONE_STEP (G_GINT64_CONSTANT(24) * 60 * 60)
+
+/* Wait for /etc/localtime to settle before reloading it */
+#define ALARM_TIMEZONE_SETTLE 1
+
+typedef struct {
+    gint64 start;  /* First second of the segment, UTC */
+    gint32 offset; /* Seconds east of UTC */
+} AlarmTimezoneSegment;
+
+static struct {
+    GTimeZone* tz;
+    gchar* tz_env;     /* TZ when tz was loaded */
+    GArray* segments;  /* AlarmTimezoneSegment ordered by start */
+    gint64 start, end; /* Range covered by segments, UTC */
+
+    GFileMonitor* monitor;
+    guint changed_id;
+
+    AlarmTimezoneChangedFunc func;
+    gpointer func_data;
+} cache;
+
+static void alarm_timezone_invalidate(void)
+{
+    g_clear_pointer(&cache.tz, g_time_zone_unref);
+    g_clear_pointer(&cache.tz_env, g_free);
+    cache.start = cache.end = 0;
+}
+
+static gboolean alarm_timezone_changed(gpointer data)
+{
+    cache.changed_id = 0;
+
+    g_debug("AlarmTimezone: local time zone changed");
+
+    alarm_timezone_invalidate();
+
+    if(cache.func)
+        cache.func(cache.func_data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void alarm_timezone_file_changed(GFileMonitor* monitor, GFile* file, GFile* other_file, GFileMonitorEvent event, gpointer data)
+{
+    if(event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+        return;
+
+    // The file is usually replaced in several steps
+    if(cache.changed_id)
+        g_source_remove(cache.changed_id);
+
+    cache.changed_id = g_timeout_add_seconds(ALARM_TIMEZONE_SETTLE, alarm_timezone_changed, NULL);
+}
+
+static void alarm_timezone_monitor(void)
+{
+    GFile* file = g_file_new_for_path(ALARM_TIMEZONE_LOCALTIME);
+    GError* err = NULL;
+
+    cache.monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &err);
+    g_object_unref(file);
+
+    if(cache.monitor == NULL) {
+        g_warning("AlarmTimezone: Could not monitor %s: %s", ALARM_TIMEZONE_LOCALTIME, err->message);
+        g_error_free(err);
+        return;
+    }
+
+    g_signal_connect(cache.monitor, "changed", G_CALLBACK(alarm_timezone_file_changed), NULL);
+}
+
+static gint32 alarm_timezone_get_offset(gint64 utc)
+{
+    return g_time_zone_get_offset(cache.tz, g_time_zone_find_interval(cache.tz, G_TIME_TYPE_UNIVERSAL, utc));
+}
+
+static void alarm_timezone_add_segment(gint64 start, gint32 offset)
+{
+    AlarmTimezoneSegment segment = { start, offset };
+
+    g_array_append_val(cache.segments, segment);
+}
+
+/*
+ * Look up the offsets around the given time
+ */
+static void alarm_timezone_build(gint64 around)
+{
+    gint32 offset;
+
+    g_array_set_size(cache.segments, 0);
+
+    cache.start = around - ALARM_TIMEZONE_RANGE_BEFORE;
+    cache.end = around + ALARM_TIMEZONE_RANGE_AFTER;
+
+    offset = alarm_timezone_get_offset(cache.start);
+    alarm_timezone_add_segment(cache.start, offset);
+
+    for(gint64 t = cache.start; t < cache.end; t += ALARM_TIMEZONE_STEP) {
+        gint64 lo = t, hi = MIN(t + ALARM_TIMEZONE_STEP, cache.end);
+        const gint32 next = alarm_timezone_get_offset(hi);
+
+        if(next == offset)
+            continue;
+
+        // Find the first second with the new offset
+        while(hi - lo > 1) {
+            const gint64 mid = lo + (hi - lo) / 2;
+
+            if(alarm_timezone_get_offset(mid) == offset)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        alarm_timezone_add_segment(hi, next);
+        offset = next;
+    }
+
+    g_debug("AlarmTimezone: cached %u offsets from %" G_GINT64_FORMAT, cache.segments->len, cache.start);
+}
+
+/*
+ * Load the time zone if needed, and return whether t is within the cache
+ */
+static gboolean alarm_timezone_ensure(gint64 t)
+{
+    const gchar* tz_env = g_getenv("TZ");
+
+    if(cache.tz != NULL && g_strcmp0(tz_env, cache.tz_env) != 0) {
+        alarm_timezone_invalidate();
+
+        // Let the times that were converted before be converted again, but
+        // not from within the conversion that noticed
+        if(cache.changed_id)
+            g_source_remove(cache.changed_id);
+
+        cache.changed_id = g_idle_add(alarm_timezone_changed, NULL);
+    }
+
+    if(cache.tz == NULL) {
+        if(cache.segments == NULL) {
+            cache.segments = g_array_new(FALSE, FALSE, sizeof(AlarmTimezoneSegment));
+            alarm_timezone_monitor();
+        }
+
+        // Bypass the cache of g_time_zone_new_local(), which ignores changes to /etc/localtime
+#if GLIB_CHECK_VERSION(2, 68, 0)
+        cache.tz = g_time_zone_new_identifier(NULL);
+        if(cache.tz == NULL)
+            cache.tz = g_time_zone_new_utc();
+#else
+        cache.tz = g_time_zone_new(NULL);
+#endif
+        cache.tz_env = g_strdup(tz_env);
+    }
+
+    if(t >= cache.start && t < cache.end)
+        return TRUE;
+
+    // Only follow the current time, so that the odd far off time doesn't
+    // make the next one near now rebuild it again
+    const gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    if(now < cache.start || now >= cache.end)
+        alarm_timezone_build(now);
+
+    return t >= cache.start && t < cache.end;
+}
+
+static inline AlarmTimezoneSegment* alarm_timezone_segment(guint i)
+{
+    return &g_array_index(cache.segments, AlarmTimezoneSegment, i);
+}
+
+/*
+ * Same as alarm_timezone_from_local(), without the cache. The offsets a
+ * day before and after are those on either side of any transition.
+ */
+static gint64 alarm_timezone_from_local_uncached(gint64 local)
+{
+    const gint32 before = alarm_timezone_get_offset(local - ALARM_TIMEZONE_STEP);
+    const gint32 after = alarm_timezone_get_offset(local + ALARM_TIMEZONE_STEP);
+
+    if(alarm_timezone_get_offset(local - before) == before)
+        return local - before;
+
+    if(alarm_timezone_get_offset(local - after) == after)
+        return local - after;
+
+    // Skipped by the transition
+    return local - before;
+}
+
+gint64 alarm_timezone_to_local(gint64 utc)
+{
+    guint i;
+
+    if(!alarm_timezone_ensure(utc))
+        return utc + alarm_timezone_get_offset(utc);
+
+    for(i = cache.segments->len - 1; i > 0; i--) {
+        if(alarm_timezone_segment(i)->start <= utc)
+            break;
+    }
+
+    return utc + alarm_timezone_segment(i)->offset;
+}
+
+gint64 alarm_timezone_from_local(gint64 local)
+{
+    guint i;
+
+    if(!alarm_timezone_ensure(local))
+        return alarm_timezone_from_local_uncached(local);
+
+    for(i = 0; i < cache.segments->len; i++) {
+        const AlarmTimezoneSegment* segment = alarm_timezone_segment(i);
+        const gint64 end = (i + 1 < cache.segments->len) ? alarm_timezone_segment(i + 1)->start : cache.end;
+        const gint64 utc = local - segment->offset;
+
+        if(utc < segment->start && i > 0) {
+            // Skipped by the transition into this segment
+            return local - alarm_timezone_segment(i - 1)->offset;
+        }
+
+        if(utc < end)
+            return utc;
+    }
+
+    return local - alarm_timezone_segment(cache.segments->len - 1)->offset;
+}
+
+void alarm_timezone_set_changed_func(AlarmTimezoneChangedFunc func, gpointer data)
+{
+    cache.func = func;
+    cache.func_data = data;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * alarm-timezone.h -- Cached local time zone
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#ifndef ALARM_TIMEZONE_H_
+#define ALARM_TIMEZONE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Called when the local time zone has changed, either because
+ * /etc/localtime was replaced or TZ was changed.
+ */
+typedef void (*AlarmTimezoneChangedFunc)(gpointer data);
+
+void alarm_timezone_set_changed_func(AlarmTimezoneChangedFunc func, gpointer data);
+
+/*
+ * Convert a UNIX timestamp to local time, expressed as seconds since
+ * 1970-01-01 00:00:00 local time.
+ */
+gint64 alarm_timezone_to_local(gint64 utc);
+
+/*
+ * Convert local time, expressed as seconds since 1970-01-01 00:00:00
+ * local time, to a UNIX timestamp.
+ *
+ * Times skipped by a transition are moved forward by its length.
+ * Times repeated by a transition resolve to their first occurrence.
+ */
+gint64 alarm_timezone_from_local(gint64 local);
+
+G_END_DECLS
+
+#endif /*ALARM_TIMEZONE_H_*/
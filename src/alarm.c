@@ -12,6 +12,13 @@
 
 #include "alarm.h"
 #include "alarm-glib-enums.h"
+#include "alarm-agenda.h"
+#include "alarm-cron.h"
+#include "alarm-log.h"
+#include "alarm-scheduler.h"
+#include "alarm-storage.h"
+#include "alarm-store.h"
+#include "alarm-timezone.h"
 #include <gio/gio.h>
 
 extern void alarm_applet_request_resize(struct _AlarmApplet* applet);
@@ -21,7 +28,26 @@ typedef struct _AlarmPrivate AlarmPrivate;
 struct _AlarmPrivate {
     GSettings* settings;
     guint gconf_listener;
-    guint timer_id;
+    AlarmSchedulerEntry timer_entry;
+    AlarmScheduler* timer_scheduler; // Scheduler timer_entry is queued in
+    gboolean snoozed;                // The timestamp was set by a snooze rather than from the time
+
+    /* Timers count down on the boot clock, see alarm_timer_set_deadline() */
+    gint64 deadline;        // Deadline on the boot clock in microseconds
+    gint64 remaining;       // Remaining microseconds of a paused timer, or 0. Stored.
+    gboolean deadline_sync; // The timestamp is being set from the deadline
+
+
+    /* Interval timers are due at origin + cycle * time, see alarm_timer_next_interval() */
+    gint64 origin; // Boot clock time the intervals are counted from
+    guint64 cycle; // Interval of the current deadline, 0 if not counted from origin yet
+
+    AlarmCron cron;   // Compiled from alarm->cron
+    gboolean has_cron; // Repeats according to cron instead of alarm->repeat
+
+    gboolean cold_loaded; // The cold properties have been read, see alarm_load_cold()
+    gboolean loading;     // The stored properties are being read, see alarm_load()
+    gboolean detached;    // Neither scheduled nor written back, see alarm_get_list_detached()
     MediaPlayer* player;
     guint player_timer_id;
 };
@@ -44,9 +70,22 @@ static void alarm_dispose(GObject* object);
 
 static void alarm_gsettings_connect(Alarm* alarm);
 
+static GSettings* alarm_gsettings_new(guint id);
+
+static void alarm_gsettings_read(Alarm* alarm, const gchar* const* names);
+
+static void alarm_load_cold(Alarm* alarm);
+
+static void alarm_storage_notify(GObject* object, GParamSpec* pspec, gpointer data);
+
 static void alarm_timer_start(Alarm* alarm);
 static void alarm_timer_remove(Alarm* alarm);
 static gboolean alarm_timer_is_started(Alarm* alarm);
+static void alarm_timer_set_deadline(Alarm* alarm, gint64 deadline);
+static void alarm_timer_sync_deadline(Alarm* alarm);
+static void alarm_timer_next_interval(Alarm* alarm);
+static void alarm_timer_recalculate(void);
+static void alarm_timer_time_changed(void);
 
 static void alarm_player_start(Alarm* alarm);
 static void alarm_player_stop(Alarm* alarm);
@@ -100,8 +139,18 @@ enum {
     PROP_SOUND_FILE,
     PROP_SOUND_LOOP,
     PROP_COMMAND,
+    PROP_CRON,
+    PROP_INTERVAL,
+    PROP_CATCH_UP,
+    PROP_CRITICAL,
+    PROP_REMAINING,
 };
 
+/* The properties after the id have their AlarmDirtyFlags bit in the same order */
+#define ALARM_DIRTY_FROM_PROP(prop_id) ((prop_id) > PROP_ID ? (AlarmDirtyFlags)(1 << ((prop_id) - PROP_TRIGGERED)) : 0)
+
+G_STATIC_ASSERT(ALARM_DIRTY_FROM_PROP(PROP_REMAINING) == ALARM_DIRTY_REMAINING);
+
 #define PROP_NAME_ID          "id"
 #define PROP_NAME_TRIGGERED   "triggered"
 #define PROP_NAME_TYPE        "type"
@@ -114,6 +163,39 @@ enum {
 #define PROP_NAME_SOUND_FILE  "sound-file"
 #define PROP_NAME_SOUND_LOOP  "sound-repeat"
 #define PROP_NAME_COMMAND     "command"
+#define PROP_NAME_CRON        "cron"
+#define PROP_NAME_INTERVAL    "interval"
+#define PROP_NAME_CATCH_UP    "catch-up"
+#define PROP_NAME_CRITICAL    "critical"
+#define PROP_NAME_REMAINING   "remaining"
+
+// Properties kept in the settings, with keys of the same name
+static const gchar* const alarm_stored_properties[] = {
+    PROP_NAME_TYPE,
+    PROP_NAME_TIME,
+    PROP_NAME_TIMESTAMP,
+    PROP_NAME_ACTIVE,
+    PROP_NAME_MESSAGE,
+    PROP_NAME_REPEAT,
+    PROP_NAME_NOTIFY_TYPE,
+    PROP_NAME_SOUND_FILE,
+    PROP_NAME_SOUND_LOOP,
+    PROP_NAME_COMMAND,
+    PROP_NAME_CRON,
+    PROP_NAME_INTERVAL,
+    PROP_NAME_CATCH_UP,
+    PROP_NAME_CRITICAL,
+    PROP_NAME_REMAINING,
+    NULL,
+};
+
+// Strings that scheduling doesn't need, read on first use
+static const gchar* const alarm_cold_properties[] = {
+    PROP_NAME_MESSAGE,
+    PROP_NAME_SOUND_FILE,
+    PROP_NAME_COMMAND,
+    NULL,
+};
 
 /* Signal indexes */
 enum {
@@ -127,6 +209,9 @@ enum {
 /* Signal identifier map */
 static guint alarm_signal[LAST_SIGNAL] = { 0, 0, 0, 0 };
 
+static AlarmTriggeredFunc alarm_triggered_func = NULL;
+static gpointer alarm_triggered_data = NULL;
+
 /* Prototypes for signal handlers */
 static void alarm_alarm(Alarm* alarm);
 static void alarm_cleared(Alarm* alarm);
@@ -171,6 +256,11 @@ static void alarm_class_init(AlarmClass* class)
     GParamSpec* sound_file_param;
     GParamSpec* sound_loop_param;
     GParamSpec* command_param;
+    GParamSpec* cron_param;
+    GParamSpec* interval_param;
+    GParamSpec* catch_up_param;
+    GParamSpec* critical_param;
+    GParamSpec* remaining_param;
 
     GObjectClass* g_object_class;
 
@@ -214,6 +304,16 @@ static void alarm_class_init(AlarmClass* class)
 
     command_param = g_param_spec_string(PROP_NAME_COMMAND, "command", "command to run", ALARM_DEFAULT_COMMAND, G_PARAM_READWRITE);
 
+    cron_param = g_param_spec_string(PROP_NAME_CRON, "cron", "cron expression to repeat the alarm by", ALARM_DEFAULT_CRON, G_PARAM_READWRITE);
+
+    interval_param = g_param_spec_boolean(PROP_NAME_INTERVAL, "interval", "whether the timer repeats at a fixed interval", ALARM_DEFAULT_INTERVAL, G_PARAM_READWRITE);
+
+    catch_up_param = g_param_spec_enum(PROP_NAME_CATCH_UP, "catch up", "what to do about missed occurrences", ALARM_TYPE_CATCH_UP, ALARM_DEFAULT_CATCH_UP, G_PARAM_READWRITE);
+
+    critical_param = g_param_spec_boolean(PROP_NAME_CRITICAL, "critical", "whether the alarm is scheduled apart from the UI", ALARM_DEFAULT_CRITICAL, G_PARAM_READWRITE);
+
+    remaining_param = g_param_spec_int64(PROP_NAME_REMAINING, "remaining", "microseconds left on a paused timer", 0, G_MAXINT64, ALARM_DEFAULT_REMAINING, G_PARAM_READWRITE);
+
     /* override base object methods */
     g_object_class->set_property = alarm_set_property;
     g_object_class->get_property = alarm_get_property;
@@ -233,6 +333,11 @@ static void alarm_class_init(AlarmClass* class)
     g_object_class_install_property(g_object_class, PROP_SOUND_FILE, sound_file_param);
     g_object_class_install_property(g_object_class, PROP_SOUND_LOOP, sound_loop_param);
     g_object_class_install_property(g_object_class, PROP_COMMAND, command_param);
+    g_object_class_install_property(g_object_class, PROP_CRON, cron_param);
+    g_object_class_install_property(g_object_class, PROP_INTERVAL, interval_param);
+    g_object_class_install_property(g_object_class, PROP_CATCH_UP, catch_up_param);
+    g_object_class_install_property(g_object_class, PROP_CRITICAL, critical_param);
+    g_object_class_install_property(g_object_class, PROP_REMAINING, remaining_param);
 
     /* set signal handlers */
     class->alarm = alarm_alarm;
@@ -266,11 +371,76 @@ static void alarm_class_init(AlarmClass* class)
                                                1, G_TYPE_UINT);
 }
 
+// Alarms constructed while set are detached, see alarm_get_list_detached()
+static gboolean alarm_construct_detached = FALSE;
+
 static void alarm_init(Alarm* self)
 {
     AlarmPrivate* priv = ALARM_PRIVATE(self);
 
     self->id = -1;
+    priv->timer_entry.data = self;
+    priv->detached = alarm_construct_detached;
+}
+
+// Nesting count of alarm_timers_freeze()
+static guint alarm_timers_frozen = 0;
+
+/*
+ * Read the stored properties of an alarm, and keep them in sync from then on
+ */
+static void alarm_load(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    if(priv->detached) {
+        // Once from wherever the alarm is stored, leaving it untouched
+        priv->cold_loaded = TRUE;
+
+        if(alarm_storage_load(alarm, FALSE))
+            alarm_storage_load(alarm, TRUE);
+        else
+            alarm_gsettings_read(alarm, alarm_stored_properties);
+        return;
+    }
+
+    if(alarm_storage_is_packed()) {
+        // From the packed key, or all at once from the alarm's own path
+        if(!alarm_storage_load(alarm, FALSE)) {
+            priv->cold_loaded = TRUE;
+            alarm_gsettings_read(alarm, alarm_stored_properties);
+        }
+
+        g_signal_handlers_disconnect_by_func(alarm, alarm_storage_notify, NULL);
+        g_signal_connect(alarm, "notify", G_CALLBACK(alarm_storage_notify), NULL);
+        return;
+    }
+
+    priv->settings = alarm_gsettings_new(alarm->id);
+    alarm_storage_delay(priv->settings);
+
+    alarm_gsettings_connect(alarm);
+
+    // Left over from packed storage, move it over to the path
+    if(alarm_storage_load(alarm, FALSE)) {
+        alarm_load_cold(alarm);
+        alarm_storage_load(alarm, TRUE);
+        alarm_storage_remove(alarm->id);
+    }
+}
+
+/*
+ * Many alarms share the same sound files and commands, so these strings
+ * are interned. Equal strings are then the same pointer.
+ */
+static void alarm_string_set(gchar** field, const gchar* value)
+{
+    gchar* str = value ? g_ref_string_new_intern(value) : NULL;
+
+    if(*field)
+        g_ref_string_release(*field);
+
+    *field = str;
 }
 
 /* set an Alarm property */
@@ -280,13 +450,13 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
     Alarm* alarm = ALARM(object);
 
     // DEBUGGING INFO
-    GValue strval = G_VALUE_INIT;
-    g_value_init(&strval, G_TYPE_STRING);
-    g_value_transform(value, &strval);
-    g_debug("Alarm(%p) #%d: set %s=%s", alarm, alarm->id, pspec->name, g_value_get_string(&strval));
-    g_value_unset(&strval);
-
-    alarm->changed = TRUE; // Do this for all properties for now (not too much overhead, anyway)
+    if(alarm_log_debug_enabled(ALARM_LOG_ALARM)) {
+        GValue strval = G_VALUE_INIT;
+        g_value_init(&strval, G_TYPE_STRING);
+        g_value_transform(value, &strval);
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: set %s=%s", alarm, alarm->id, pspec->name, g_value_get_string(&strval));
+        g_value_unset(&strval);
+    }
 
     switch(prop_id) {
     case PROP_ID:
@@ -301,11 +471,21 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
         }
         alarm->id = d;
 
-        gchar* gsettings_dir = alarm_gsettings_get_dir(alarm);
-        priv->settings = g_settings_new_with_path("io.github.alarm-clock-applet.alarm", gsettings_dir);
-        g_free(gsettings_dir);
-
-        alarm_gsettings_connect(alarm);
+        // Keep the stored timestamp until all properties are read, the
+        // order they are read in shouldn't move it
+        priv->loading = TRUE;
+        alarm_load(alarm);
+        priv->loading = FALSE;
+
+        // While the timers are frozen, alarm_reconcile() catches up from
+        // the stored timestamp. Otherwise move on to the next occurrence.
+        if(alarm->active && !priv->detached && alarm_timers_frozen == 0 && alarm_should_repeat(alarm)) {
+            if(alarm->type == ALARM_TYPE_CLOCK)
+                alarm_update_timestamp(alarm);
+            else if(priv->deadline <= alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME))
+                // Keep the phase of the stored deadline
+                alarm_timer_next_interval(alarm);
+        }
         break;
     }
     case PROP_TRIGGERED:
@@ -318,7 +498,10 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
     case PROP_TYPE:
         alarm->type = g_value_get_enum(value);
 
-        if(alarm->active) {
+        if(alarm->type == ALARM_TYPE_TIMER)
+            alarm_timer_sync_deadline(alarm);
+
+        if(alarm->active && !priv->loading) {
             // Update timestamp
             alarm_update_timestamp(alarm);
         }
@@ -326,13 +509,23 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
     case PROP_TIME:
         alarm->time = g_value_get_int64(value);
 
-        if(alarm->active) {
+        if(alarm->active && !priv->loading) {
             // Update timestamp
             alarm_update_timestamp(alarm);
         }
         break;
     case PROP_TIMESTAMP:
         alarm->timestamp = g_value_get_int64(value);
+
+        if(alarm->type == ALARM_TYPE_TIMER && !priv->deadline_sync) {
+            // Set from elsewhere (stored settings, snooze)
+            alarm_timer_sync_deadline(alarm);
+        }
+
+        if(alarm->active) {
+            // (Re)schedule for the new timestamp
+            alarm_timer_start(alarm);
+        }
         break;
     case PROP_ACTIVE:
         alarm->active = g_value_get_boolean(value);
@@ -347,13 +540,13 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
         }
         break;
     case PROP_MESSAGE:
-        g_free(alarm->message);
-        alarm->message = g_strdup(g_value_get_string(value));
+        alarm_load_cold(alarm);
+        alarm_string_set(&alarm->message, g_value_get_string(value));
         break;
     case PROP_REPEAT:
         alarm->repeat = g_value_get_flags(value);
 
-        if(alarm->active)
+        if(alarm->active && !priv->loading)
             alarm_update_timestamp(alarm);
 
         break;
@@ -361,20 +554,53 @@ static void alarm_set_property(GObject* object, guint prop_id, const GValue* val
         alarm->notify_type = g_value_get_enum(value);
         break;
     case PROP_SOUND_FILE:
-        g_free(alarm->sound_file);
-        alarm->sound_file = g_strdup(g_value_get_string(value));
+        alarm_load_cold(alarm);
+        alarm_string_set(&alarm->sound_file, g_value_get_string(value));
         break;
     case PROP_SOUND_LOOP:
         alarm->sound_loop = g_value_get_boolean(value);
         break;
     case PROP_COMMAND:
-        g_free(alarm->command);
-        alarm->command = g_strdup(g_value_get_string(value));
+        alarm_load_cold(alarm);
+        alarm_string_set(&alarm->command, g_value_get_string(value));
+        break;
+    case PROP_CRON:
+        g_free(alarm->cron);
+        alarm->cron = g_strdup(g_value_get_string(value));
+
+        priv->has_cron = alarm->cron && *alarm->cron && alarm_cron_parse(alarm->cron, &priv->cron);
+        if(alarm->cron && *alarm->cron && !priv->has_cron)
+            g_warning("Alarm(%p) #%d: Invalid cron expression '%s'", alarm, alarm->id, alarm->cron);
+
+        if(alarm->active && !priv->loading)
+            alarm_update_timestamp(alarm);
+
+        break;
+    case PROP_INTERVAL:
+        alarm->interval = g_value_get_boolean(value);
+        break;
+    case PROP_CATCH_UP:
+        alarm->catch_up = g_value_get_enum(value);
+        break;
+    case PROP_CRITICAL:
+        alarm->critical = g_value_get_boolean(value);
+
+        if(alarm_timer_is_started(alarm)) {
+            // Move over to the other scheduler
+            alarm_timer_start(alarm);
+        }
+        break;
+    case PROP_REMAINING:
+        priv->remaining = g_value_get_int64(value);
         break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-        break;
+        return;
     }
+
+    // Also marks the property dirty to request a UI update
+    if(alarm->store)
+        alarm_store_update(alarm->store, alarm, ALARM_DIRTY_FROM_PROP(prop_id));
 }
 
 /* retrive an Alarm property */
@@ -402,7 +628,7 @@ static void alarm_get_property(GObject* object, guint prop_id, GValue* value, GP
         g_value_set_boolean(value, alarm->active);
         break;
     case PROP_MESSAGE:
-        g_value_set_string(value, alarm->message);
+        g_value_set_string(value, alarm_get_message(alarm));
         break;
     case PROP_REPEAT:
         g_value_set_flags(value, alarm->repeat);
@@ -411,13 +637,28 @@ static void alarm_get_property(GObject* object, guint prop_id, GValue* value, GP
         g_value_set_enum(value, alarm->notify_type);
         break;
     case PROP_SOUND_FILE:
-        g_value_set_string(value, alarm->sound_file);
+        g_value_set_string(value, alarm_get_sound_file(alarm));
         break;
     case PROP_SOUND_LOOP:
         g_value_set_boolean(value, alarm->sound_loop);
         break;
     case PROP_COMMAND:
-        g_value_set_string(value, alarm->command);
+        g_value_set_string(value, alarm_get_command(alarm));
+        break;
+    case PROP_CRON:
+        g_value_set_string(value, alarm->cron);
+        break;
+    case PROP_INTERVAL:
+        g_value_set_boolean(value, alarm->interval);
+        break;
+    case PROP_CATCH_UP:
+        g_value_set_enum(value, alarm->catch_up);
+        break;
+    case PROP_CRITICAL:
+        g_value_set_boolean(value, alarm->critical);
+        break;
+    case PROP_REMAINING:
+        g_value_set_int64(value, ALARM_PRIVATE(alarm)->remaining);
         break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -454,7 +695,7 @@ void alarm_error_trigger(Alarm* alarm, AlarmErrorCode code, const gchar* msg)
 
 static void alarm_player_changed(Alarm* alarm, MediaPlayerState state)
 {
-    g_debug("Alarm(%p) #%d: player_changed to %d", alarm, alarm->id, state);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: player_changed to %d", alarm, alarm->id, state);
 }
 
 static inline void alarm_set_triggered(Alarm* alarm, const gboolean triggered)
@@ -466,13 +707,25 @@ static inline void alarm_set_triggered(Alarm* alarm, const gboolean triggered)
     g_value_unset(&val);
 }
 
+/*
+ * Forget the remaining time of a paused timer
+ */
+static void alarm_clear_remaining(Alarm* alarm)
+{
+    if(ALARM_PRIVATE(alarm)->remaining > 0)
+        g_object_set(alarm, PROP_NAME_REMAINING, (gint64)0, NULL);
+}
+
 /*
  * ALARM signal {{
  */
 
 static void alarm_alarm(Alarm* alarm)
 {
-    g_debug("Alarm(%p) #%d: alarm() DING!", alarm, alarm->id);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: alarm() DING!", alarm, alarm->id);
+
+    // Notify once for all the properties set along the way
+    g_object_freeze_notify(G_OBJECT(alarm));
 
     // Clear first, if needed
     alarm_clear(alarm);
@@ -481,32 +734,109 @@ static void alarm_alarm(Alarm* alarm)
     alarm_set_triggered(alarm, TRUE);
 
     // Do we want to repeat this alarm?
-    if(alarm_should_repeat(alarm)) {
-        g_debug("Alarm(%p) #%d: alarm() Repeating...", alarm, alarm->id);
+    if(alarm->type == ALARM_TYPE_TIMER && alarm->interval) {
+        alarm_timer_next_interval(alarm);
+    } else if(alarm_should_repeat(alarm)) {
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: alarm() Repeating...", alarm, alarm->id);
         alarm_update_timestamp(alarm);
     } else {
         alarm_disable(alarm);
     }
 
-    switch(alarm->notify_type) {
-    case ALARM_NOTIFY_SOUND:
-        // Start sound playback
-        g_debug("Alarm(%p) #%d: alarm() Start player", alarm, alarm->id);
-        alarm_player_start(alarm);
-        break;
-    case ALARM_NOTIFY_COMMAND:
-        // Start app
-        g_debug("Alarm(%p) #%d: alarm() Start command", alarm, alarm->id);
-        alarm_command_run(alarm);
-        break;
-    default:
-        g_warning("Alarm(%p) #%d: UNKNOWN NOTIFICATION TYPE %d", alarm, alarm->id, alarm->notify_type);
-    }
+    g_object_thaw_notify(G_OBJECT(alarm));
 }
 
 void alarm_trigger(Alarm* alarm)
 {
-    g_signal_emit(alarm, alarm_signal[SIGNAL_ALARM], 0, NULL);
+    GPtrArray* alarms = g_ptr_array_new();
+
+    g_ptr_array_add(alarms, alarm);
+    alarm_trigger_batch(alarms);
+    g_ptr_array_free(alarms, TRUE);
+}
+
+/*
+ * Sound alarms triggered along with one that is already playing, and
+ * the idle that starts the next of them once that one is cleared
+ */
+static GQueue alarm_sound_waiting = G_QUEUE_INIT;
+static guint alarm_sound_handoff_id = 0;
+
+static gboolean alarm_sound_handoff(gpointer data)
+{
+    Alarm* alarm;
+
+    alarm_sound_handoff_id = 0;
+
+    while((alarm = g_queue_pop_head(&alarm_sound_waiting))) {
+        if(alarm->triggered) {
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: taking over the sound", alarm, alarm->id);
+            alarm_player_start(alarm);
+            break;
+        }
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Trigger several alarms that are due at the same time.
+ *
+ * Each alarm still gets its own "alarm" signal, but only one of them
+ * starts the sound, and the triggered func is called once for all of
+ * them, so that the UI isn't updated once per alarm. When the playing
+ * alarm is cleared, the next sound alarm of the batch that is still
+ * triggered takes over, so stopping one doesn't silence the rest.
+ *
+ * counts holds the number of occurrences caught up on for each alarm, or
+ * is NULL if each is triggered once. Commands are run once per occurrence.
+ */
+static void alarm_trigger_batch_full(GPtrArray* alarms, GArray* counts, gboolean missed)
+{
+    gboolean playing = FALSE;
+
+    for(guint i = 0; i < alarms->len; i++)
+        g_signal_emit(g_ptr_array_index(alarms, i), alarm_signal[SIGNAL_ALARM], 0, NULL);
+
+    for(guint i = 0; i < alarms->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(alarms, i));
+
+        switch(alarm->notify_type) {
+        case ALARM_NOTIFY_SOUND:
+            // Start sound playback
+            if(playing) {
+                g_queue_push_tail(&alarm_sound_waiting, alarm);
+                break;
+            }
+
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: alarm() Start player", alarm, alarm->id);
+            alarm_player_start(alarm);
+            playing = TRUE;
+            break;
+        case ALARM_NOTIFY_COMMAND:
+            // Start app
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: alarm() Start command", alarm, alarm->id);
+            for(guint k = counts ? g_array_index(counts, guint, i) : 1; k > 0; k--)
+                alarm_command_run(alarm);
+            break;
+        default:
+            g_warning("Alarm(%p) #%d: UNKNOWN NOTIFICATION TYPE %d", alarm, alarm->id, alarm->notify_type);
+        }
+    }
+
+    if(alarm_triggered_func)
+        alarm_triggered_func(alarms, counts ? (const guint*)counts->data : NULL, missed, alarm_triggered_data);
+}
+
+void alarm_trigger_batch(GPtrArray* alarms)
+{
+    alarm_trigger_batch_full(alarms, NULL, FALSE);
+}
+
+void alarm_set_triggered_func(AlarmTriggeredFunc func, gpointer data)
+{
+    alarm_triggered_func = func;
+    alarm_triggered_data = data;
 }
 
 /*
@@ -516,11 +846,18 @@ void alarm_trigger(Alarm* alarm)
  */
 void alarm_set_enabled(Alarm* alarm, gboolean enabled)
 {
+    g_object_freeze_notify(G_OBJECT(alarm));
+
     if(enabled) {
         alarm_update_timestamp(alarm);
+    } else {
+        // Only alarm_pause() keeps it
+        alarm_clear_remaining(alarm);
     }
 
     g_object_set(alarm, "active", enabled, NULL);
+
+    g_object_thaw_notify(G_OBJECT(alarm));
 }
 
 void alarm_enable(Alarm* alarm)
@@ -540,23 +877,25 @@ void alarm_disable(Alarm* alarm)
 void alarm_delete(Alarm* alarm)
 {
     AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    // With packed storage, the path may still hold what the alarm was migrated from
+    GSettings* settings = priv->settings ? g_object_ref(priv->settings) : alarm_gsettings_new(alarm->id);
 
-    g_settings_reset(priv->settings, PROP_NAME_TYPE);
-    g_settings_reset(priv->settings, PROP_NAME_TIME);
-    g_settings_reset(priv->settings, PROP_NAME_TIMESTAMP);
-    g_settings_reset(priv->settings, PROP_NAME_ACTIVE);
-    g_settings_reset(priv->settings, PROP_NAME_MESSAGE);
-    g_settings_reset(priv->settings, PROP_NAME_REPEAT);
-    g_settings_reset(priv->settings, PROP_NAME_NOTIFY_TYPE);
-    g_settings_reset(priv->settings, PROP_NAME_SOUND_FILE);
-    g_settings_reset(priv->settings, PROP_NAME_SOUND_LOOP);
-    g_settings_reset(priv->settings, PROP_NAME_COMMAND);
+    for(guint i = 0; alarm_stored_properties[i]; i++)
+        g_settings_reset(settings, alarm_stored_properties[i]);
+
+    // The id is free again right away. The next alarm to get it mustn't
+    // read these, nor have its own writes reset later.
+    alarm_storage_apply(settings);
+
+    g_object_unref(settings);
+
+    alarm_storage_remove(alarm->id);
 }
 
 void alarm_unref(Alarm* alarm)
 {
-    // This should be the final unref call
-    g_assert(G_OBJECT(alarm)->ref_count == 1);
+    // This should be the final unref call, except that the critical thread
+    // may briefly hold one while dispatching, see alarm_critical_unref()
     g_object_unref(alarm);
 }
 
@@ -567,7 +906,9 @@ void alarm_snooze(Alarm* alarm, guint seconds)
 {
     g_assert(alarm->triggered);
 
-    g_debug("Alarm(%p) #%d: snooze() for %d minutes", alarm, alarm->id, seconds / 60);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: snooze() for %d minutes", alarm, alarm->id, seconds / 60);
+
+    g_object_freeze_notify(G_OBJECT(alarm));
 
     // Silence!
     alarm_clear(alarm);
@@ -575,8 +916,11 @@ void alarm_snooze(Alarm* alarm, guint seconds)
     // Remind later
     time_t now = time(NULL);
 
+    ALARM_PRIVATE(alarm)->snoozed = TRUE;
     g_object_set(alarm, "timestamp", now + seconds, "active", TRUE, NULL);
 
+    g_object_thaw_notify(G_OBJECT(alarm));
+
     //    alarm_timer_start (alarm);
 }
 
@@ -585,13 +929,20 @@ void alarm_snooze(Alarm* alarm, guint seconds)
  */
 static void alarm_cleared(Alarm* alarm)
 {
-    g_debug("Alarm(%p) #%d: cleared()", alarm, alarm->id);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: cleared()", alarm, alarm->id);
+
+    const gboolean playing = ALARM_PRIVATE(alarm)->player != NULL;
 
     // Update triggered flag
     alarm_set_triggered(alarm, FALSE);
 
     // Stop player
+    g_queue_remove(&alarm_sound_waiting, alarm);
     alarm_player_stop(alarm);
+
+    // From an idle, so that clearing them all doesn't start each in turn
+    if(playing && !g_queue_is_empty(&alarm_sound_waiting) && alarm_sound_handoff_id == 0)
+        alarm_sound_handoff_id = g_idle_add(alarm_sound_handoff, NULL);
 }
 
 /*
@@ -616,222 +967,1121 @@ gboolean alarm_is_playing(Alarm* a)
 }
 
 
-static gboolean alarm_timer_update(Alarm* alarm)
-{
-    time_t now;
+/*
+ * All active alarms share a single scheduler per clock, which wakes up
+ * only when the earliest of them is due. Clocks are scheduled on wall
+ * clock time, timers on the boot clock.
+ *
+ * Critical alarms have their own schedulers, see alarm_critical_dispatch().
+ */
+static AlarmScheduler* alarm_schedulers[2][2] = {
+    [FALSE] = { [ALARM_SCHEDULER_CLOCK_REALTIME] = NULL, [ALARM_SCHEDULER_CLOCK_BOOTTIME] = NULL },
+    [TRUE] = { [ALARM_SCHEDULER_CLOCK_REALTIME] = NULL, [ALARM_SCHEDULER_CLOCK_BOOTTIME] = NULL },
+};
 
-    time(&now);
+/*
+ * Catch up {{
+ */
 
-    if(now >= alarm->timestamp) {
-        alarm_trigger(alarm);
+// Lateness beyond which an occurrence counts as missed
+#define ALARM_CATCH_UP_THRESHOLD (60 * G_USEC_PER_SEC)
+
+/*
+ * The clocks as of the last dispatch. Time spent suspended shows up as
+ * the boot clock running ahead of the monotonic clock, and a change of
+ * the system time as the real time clock running ahead of the boot clock.
+ */
+static struct {
+    gint64 monotonic;
+    gint64 boottime;
+    gint64 realtime;
+} alarm_clock_ref;
 
-        // Remove callback only if we don't intend to repeat the alarm
-        return alarm_should_repeat(alarm);
-    } else if(alarm->timestamp - now <= 10) {
-        g_debug("Alarm(%p) #%d: -%2d...", alarm, alarm->id, (int)(alarm->timestamp - now));
+static gboolean alarm_catch_up_detect_jump(void)
+{
+    const gint64 monotonic = g_get_monotonic_time();
+    const gint64 boottime = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+    const gint64 realtime = g_get_real_time();
+    gboolean jump = FALSE;
+
+    if(alarm_clock_ref.realtime != 0) {
+        const gint64 suspended = (boottime - alarm_clock_ref.boottime) - (monotonic - alarm_clock_ref.monotonic);
+        const gint64 stepped = (realtime - alarm_clock_ref.realtime) - (boottime - alarm_clock_ref.boottime);
+
+        jump = suspended > ALARM_CATCH_UP_THRESHOLD || stepped > ALARM_CATCH_UP_THRESHOLD;
+        if(jump)
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm: time jump, suspended %" G_GINT64_FORMAT "s, stepped %" G_GINT64_FORMAT "s", suspended / G_USEC_PER_SEC, stepped / G_USEC_PER_SEC);
     }
 
-    // Keep callback
-    return TRUE;
+    alarm_clock_ref.monotonic = monotonic;
+    alarm_clock_ref.boottime = boottime;
+    alarm_clock_ref.realtime = realtime;
+
+    return jump;
 }
 
-static void alarm_timer_start(Alarm* alarm)
+/*
+ * Expand due clock alarms into the occurrences they have missed, in
+ * chronological order, and apply their catch up policy. Returns the
+ * alarms to trigger, each once, and sets counts to the number of
+ * occurrences to trigger for each of them. Alarms that trigger for none
+ * of them are moved on to their next occurrence, or disabled.
+ */
+static GPtrArray* alarm_catch_up(GPtrArray* due, gint64 now, GArray** counts)
 {
-    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    GPtrArray* alarms = g_ptr_array_new_full(due->len, g_object_unref);
+    GHashTable* seen = g_hash_table_new(NULL, NULL); // Alarm -> index in alarms + 1
+    const guint once = 1;
+    GPtrArray* clocks = g_ptr_array_new();
+    gint64 start = now;
+    AlarmAgenda* agenda;
+    AlarmOccurrence occurrence;
+
+    *counts = g_array_sized_new(FALSE, FALSE, sizeof(guint), due->len);
+
+    for(guint i = 0; i < due->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(due, i));
+
+        // Timers catch up by themselves
+        if(alarm->type != ALARM_TYPE_CLOCK) {
+            if(alarm->interval && alarm->catch_up == ALARM_CATCH_UP_SKIP) {
+                alarm_timer_next_interval(alarm);
+                continue;
+            }
 
-    g_debug("Alarm(%p) #%d: timer_start()", alarm, alarm->id);
+            g_ptr_array_add(alarms, g_object_ref(alarm));
+            g_array_append_val(*counts, once);
+            g_hash_table_insert(seen, alarm, GUINT_TO_POINTER(alarms->len));
+            continue;
+        }
 
-    // Remove old timer, if any
-    alarm_timer_remove(alarm);
+        g_ptr_array_add(clocks, alarm);
+        start = MIN(start, alarm->timestamp);
+    }
 
-    // Keep us updated every 1 second
-    priv->timer_id = g_timeout_add_seconds(1, (GSourceFunc)alarm_timer_update, alarm);
-}
+    agenda = alarm_agenda_new(clocks, start, now + 1);
 
-static gboolean alarm_timer_is_started(Alarm* alarm)
-{
-    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    while(alarm_agenda_next(agenda, &occurrence)) {
+        Alarm* alarm = occurrence.alarm;
+        const gboolean missed = (now - occurrence.time) * G_USEC_PER_SEC > ALARM_CATCH_UP_THRESHOLD;
+        const guint index = GPOINTER_TO_UINT(g_hash_table_lookup(seen, alarm));
 
-    return priv->timer_id > 0;
-}
+        if(missed && alarm->catch_up == ALARM_CATCH_UP_SKIP)
+            continue;
 
-static void alarm_timer_remove(Alarm* alarm)
-{
-    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+        if(index > 0 && alarm->catch_up != ALARM_CATCH_UP_ALL)
+            continue;
 
-    if(alarm_timer_is_started(alarm)) {
-        g_debug("Alarm(%p) #%d: timer_remove", alarm, alarm->id);
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: catching up on %" G_GINT64_FORMAT, alarm, alarm->id, occurrence.time);
 
-        g_source_remove(priv->timer_id);
+        if(index > 0) {
+            g_array_index(*counts, guint, index - 1)++;
+            continue;
+        }
 
-        priv->timer_id = 0;
+        g_ptr_array_add(alarms, g_object_ref(alarm));
+        g_array_append_val(*counts, once);
+        g_hash_table_insert(seen, alarm, GUINT_TO_POINTER(alarms->len));
     }
-}
 
+    alarm_agenda_free(agenda);
 
-/*
- * }} ALARM signal
- */
+    for(guint i = 0; i < clocks->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(clocks, i));
 
-static void alarm_gsettings_connect(Alarm* alarm)
-{
-    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
-    // g_settings_bind(priv->settings, PROP_NAME_TRIGGERED, alarm, PROP_NAME_TRIGGERED, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_TYPE, alarm, PROP_NAME_TYPE, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_TIME, alarm, PROP_NAME_TIME, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_TIMESTAMP, alarm, PROP_NAME_TIMESTAMP, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_ACTIVE, alarm, PROP_NAME_ACTIVE, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_MESSAGE, alarm, PROP_NAME_MESSAGE, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_REPEAT, alarm, PROP_NAME_REPEAT, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_NOTIFY_TYPE, alarm, PROP_NAME_NOTIFY_TYPE, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_SOUND_FILE, alarm, PROP_NAME_SOUND_FILE, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_SOUND_LOOP, alarm, PROP_NAME_SOUND_LOOP, G_SETTINGS_BIND_DEFAULT);
-    g_settings_bind(priv->settings, PROP_NAME_COMMAND, alarm, PROP_NAME_COMMAND, G_SETTINGS_BIND_DEFAULT);
+        if(g_hash_table_contains(seen, alarm))
+            continue;
+
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: skipping missed occurrences", alarm, alarm->id);
+
+        if(alarm_should_repeat(alarm))
+            alarm_update_timestamp(alarm);
+        else
+            alarm_disable(alarm);
+    }
+
+    g_ptr_array_free(clocks, TRUE);
+    g_hash_table_destroy(seen);
+
+    return alarms;
 }
 
-static void alarm_dispose(GObject* object)
+/*
+ * Go over the alarms that have just been loaded, while the timers are
+ * frozen. Loading leaves their stored timestamps alone, so that repeating
+ * alarms aren't moved on before this looks at them. Active alarms are
+ * either missed, due or in the future. Missed
+ * ones were due while the applet wasn't running, and are caught up on
+ * and triggered as one batch. Due and future ones are left to the timers.
+ */
+void alarm_reconcile(AlarmStore* store)
 {
-    Alarm* alarm = ALARM(object);
-    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
-    GObjectClass* parent = (GObjectClass*)alarm_parent_class;
+    GPtrArray* missed = g_ptr_array_new();
+    GPtrArray* caught_up;
+    GArray* counts;
+    const gint64 now = time(NULL);
+    guint n_due = 0, n_future = 0;
+
+    for(guint i = 0; i < alarm_store_get_size(store); i++) {
+        Alarm* alarm = alarm_store_index(store, i);
+
+        if(!alarm->active)
+            continue;
+
+        if((now - alarm->timestamp) * G_USEC_PER_SEC > ALARM_CATCH_UP_THRESHOLD)
+            g_ptr_array_add(missed, alarm);
+        else if(alarm->timestamp <= now)
+            n_due++;
+        else
+            n_future++;
+    }
 
-    g_debug("Alarm(%p) #%d: dispose()", alarm, alarm->id);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm: reconcile() %u missed, %u due, %u future", missed->len, n_due, n_future);
 
-    if(parent->dispose)
-        parent->dispose(object);
+    if(missed->len > 0) {
+        caught_up = alarm_catch_up(missed, now, &counts);
 
-    g_object_unref(priv->settings);
-    alarm_timer_remove(alarm);
-    alarm_clear(alarm);
-    g_free(alarm->command);
-    g_free(alarm->sound_file);
-    g_free(alarm->message);
+        if(caught_up->len > 0)
+            alarm_trigger_batch_full(caught_up, counts, TRUE);
+
+        g_ptr_array_free(caught_up, TRUE);
+        g_array_free(counts, TRUE);
+    }
+
+    g_ptr_array_free(missed, TRUE);
 }
 
-// Called every time an alarm is created or deleted
-void alarm_update_gsettings_alarm_list(GSettings* settings, GList* alarms)
+/*
+ * }} Catch up
+ */
+
+/*
+ * Trigger the alarms that are due on the given clock
+ */
+static void alarm_timer_trigger_due(AlarmSchedulerClock clock, GPtrArray* due)
 {
-    guint32* newvalues = malloc(((size_t)g_list_length(alarms)) * sizeof(guint32));
-    gsize i;
-    GList* l;
-    for(i = 0, l = alarms; l; i++, l = l->next) {
-        const Alarm* a = ALARM(l->data);
-        newvalues[i] = a->id;
+    // Hold a reference in case an alarm is deleted by another one's handlers
+    GPtrArray* alarms = g_ptr_array_new_full(due->len, g_object_unref);
+    GArray* counts = NULL;
+    const gint64 now = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+    for(guint i = 0; i < due->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(due, i));
+
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: timer due", alarm, alarm->id);
+
+        // Missed by a whole interval, such as while suspended
+        if(alarm->type == ALARM_TYPE_TIMER && alarm->interval && alarm->catch_up == ALARM_CATCH_UP_SKIP &&
+           now - ALARM_PRIVATE(alarm)->deadline >= (gint64)alarm->time * G_USEC_PER_SEC) {
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: skipping missed interval", alarm, alarm->id);
+            alarm_timer_next_interval(alarm);
+            continue;
+        }
+
+        g_ptr_array_add(alarms, g_object_ref(alarm));
     }
 
-    GVariant* v = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, newvalues, i, sizeof(guint32));
-    g_settings_set_value(settings, "alarms", v);
-    free(newvalues);
+    // Woke up from suspend, or the time was set forward
+    if(clock == ALARM_SCHEDULER_CLOCK_REALTIME && alarm_catch_up_detect_jump()) {
+        GPtrArray* caught_up = alarm_catch_up(alarms, time(NULL), &counts);
+
+        g_ptr_array_free(alarms, TRUE);
+        alarms = caught_up;
+    }
+
+    // Repeating alarms are rescheduled when their timestamp is updated
+    alarm_trigger_batch_full(alarms, counts, FALSE);
+    g_ptr_array_free(alarms, TRUE);
+
+    if(counts)
+        g_array_free(counts, TRUE);
 }
 
-static void prop_repeat_notify(GObject* self, GParamSpec* pspec, gpointer user_data)
+static void alarm_timer_dispatch(AlarmScheduler* scheduler, GPtrArray* due, gint64 deadline, gpointer data)
 {
-    alarm_applet_request_resize(user_data);
+    GPtrArray* alarms = g_ptr_array_sized_new(due->len);
+
+    for(guint i = 0; i < due->len; i++)
+        g_ptr_array_add(alarms, ((AlarmSchedulerEntry*)g_ptr_array_index(due, i))->data);
+
+    alarm_timer_trigger_due(GPOINTER_TO_INT(data), alarms);
+    g_ptr_array_free(alarms, TRUE);
 }
 
 /*
- * Convenience function for creating a new alarm instance.
- * Passing -1 as the id will generate a new ID with alarm_gen_id
+ * Critical alarms {{
+ */
+
+/*
+ * Critical alarms are scheduled from a thread of their own, so that a
+ * busy main loop doesn't delay noticing that they are due. The thread
+ * only hands them over to the main context, where they are triggered
+ * ahead of anything else that is pending.
  */
-Alarm* alarm_new(struct _AlarmApplet* applet, GSettings* settings, gint id)
+static struct {
+    GMainContext* context;
+    GThread* thread;
+
+    /* Latencies in microseconds since the deadline */
+    guint count;
+    gint64 noticed_max;   // Until the thread dispatched them
+    gint64 triggered_max; // Until the main context triggered them
+    gint64 triggered_total;
+} alarm_critical;
+
+typedef struct {
+    AlarmSchedulerClock clock;
+    GWeakRef* alarms;  // The due alarms, which may be deleted while pending
+    guint n_alarms;
+    gint64 deadline;   // Earliest deadline, on the clock
+    gint64 noticed;    // When the thread dispatched them, on the clock
+} AlarmCriticalDue;
+
+static gpointer alarm_critical_thread(gpointer data)
 {
-    if(id < 0)
-        id = alarm_gen_id(settings);
+    GMainLoop* loop = g_main_loop_new(alarm_critical.context, FALSE);
 
-    Alarm* alarm = g_object_new(TYPE_ALARM, "id", id, NULL);
+    g_main_context_push_thread_default(alarm_critical.context);
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(alarm_critical.context);
 
-    // Ask for a resize when a property has changed that might require more space
-    g_signal_connect(alarm, "notify::" PROP_NAME_REPEAT, G_CALLBACK(prop_repeat_notify), applet);
+    g_main_loop_unref(loop);
 
-    return alarm;
+    return NULL;
 }
 
-static inline gboolean in_alarm_array(const guint32* values, const gsize count, const guint32 val)
+static void alarm_critical_due_free(gpointer data)
 {
-    for(gsize i = 0; i < count; i++)
-        if(values[i] == val)
-            return TRUE;
-    return FALSE;
+    AlarmCriticalDue* due = data;
+
+    for(guint i = 0; i < due->n_alarms; i++)
+        g_weak_ref_clear(&due->alarms[i]);
+
+    g_free(due->alarms);
+    g_free(due);
 }
 
-guint alarm_gen_id(GSettings* settings)
+/*
+ * Runs on the main context
+ */
+static gboolean alarm_critical_trigger(gpointer data)
 {
-    GVariant* var = g_settings_get_value(settings, "alarms");
-    gsize count = 0;
-    const guint32* values = g_variant_get_fixed_array(var, &count, sizeof(guint32));
-    guint32 i = 0;
-    if(values) {
-        for(i = 0; i < G_MAXUINT32; i++)
-            if(!in_alarm_array(values, count, i))
-                break;
+    AlarmCriticalDue* due = data;
+    GPtrArray* alarms = g_ptr_array_new_full(due->n_alarms, g_object_unref);
+    const gint64 noticed = due->noticed - due->deadline;
+    const gint64 triggered = alarm_scheduler_clock_get_time(due->clock) - due->deadline;
+
+    alarm_critical.count++;
+    alarm_critical.noticed_max = MAX(alarm_critical.noticed_max, noticed);
+    alarm_critical.triggered_max = MAX(alarm_critical.triggered_max, triggered);
+    alarm_critical.triggered_total += triggered;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm: critical alarms noticed after %" G_GINT64_FORMAT "us, triggered after %" G_GINT64_FORMAT "us (max %" G_GINT64_FORMAT
+            "us, %" G_GINT64_FORMAT "us, mean %" G_GINT64_FORMAT "us)",
+            noticed, triggered, alarm_critical.noticed_max, alarm_critical.triggered_max, alarm_critical.triggered_total / alarm_critical.count);
+
+    // Deactivated, deleted or rescheduled while this was pending
+    for(guint i = 0; i < due->n_alarms; i++) {
+        Alarm* alarm = g_weak_ref_get(&due->alarms[i]);
+
+        if(alarm == NULL)
+            continue;
+
+        if(!alarm->active || alarm->store == NULL || alarm_timer_is_started(alarm)) {
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: no longer due", alarm, alarm->id);
+            g_object_unref(alarm);
+            continue;
+        }
+
+        g_ptr_array_add(alarms, alarm);
     }
-    g_variant_unref(var);
 
-    g_assert(i != G_MAXUINT32);
-    return i;
+    alarm_timer_trigger_due(due->clock, alarms);
+    g_ptr_array_free(alarms, TRUE);
+
+    return G_SOURCE_REMOVE;
 }
 
-gchar* alarm_gsettings_get_dir(Alarm* alarm)
+static gboolean alarm_critical_unref_cb(gpointer data)
 {
-    gchar* key;
-
-    g_return_val_if_fail(IS_ALARM(alarm), NULL);
-
-    key = g_strdup_printf(ALARM_G_SETTINGS_BASE_DIR ALARM_G_SETTINGS_DIR_PREFIX "%d/", alarm->id);
+    g_object_unref(data);
 
-    return key;
+    return G_SOURCE_REMOVE;
 }
 
-/**
- * Compare two alarms based on ID
+/*
+ * Runs on the critical thread. The reference may be the last one if the
+ * alarm was deleted meanwhile, so drop it on the main context, where the
+ * alarm is disposed of.
  */
-static gint alarm_list_item_compare(gconstpointer a, gconstpointer b)
+static void alarm_critical_unref(gpointer data)
 {
-    Alarm* a1 = ALARM(a);
-    Alarm* a2 = ALARM(b);
-
-    return a1->id - a2->id;
+    g_main_context_invoke_full(NULL, G_PRIORITY_HIGH, alarm_critical_unref_cb, data, NULL);
 }
 
 /*
- * Get list of alarms in gsettings
+ * Runs on the critical thread
  */
-GList* alarm_get_list(struct _AlarmApplet* applet, GSettings* settings)
+static void alarm_critical_dispatch(AlarmScheduler* scheduler, GPtrArray* entries, gint64 deadline, gpointer data)
 {
-    GList* ret = NULL;
+    AlarmCriticalDue* due = g_new0(AlarmCriticalDue, 1);
 
-    GVariant* var = g_settings_get_value(settings, "alarms");
-    gsize count = 0;
+    due->clock = GPOINTER_TO_INT(data);
+    due->alarms = g_new0(GWeakRef, entries->len);
+    due->n_alarms = entries->len;
+    due->deadline = deadline;
+    due->noticed = alarm_scheduler_clock_get_time(due->clock);
+
+    // Alive while referenced by the scheduler, see alarm_critical_scheduler_new().
+    // Holding them strongly past that would keep deleted alarms around.
+    for(guint i = 0; i < entries->len; i++)
+        g_weak_ref_init(&due->alarms[i], ((AlarmSchedulerEntry*)g_ptr_array_index(entries, i))->data);
+
+    g_main_context_invoke_full(NULL, G_PRIORITY_HIGH, alarm_critical_trigger, due, alarm_critical_due_free);
+}
+
+static gboolean alarm_critical_clock_changed_cb(gpointer data)
+{
+    alarm_timer_time_changed();
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Runs on the critical thread
+ */
+static void alarm_critical_clock_changed(AlarmScheduler* scheduler, gpointer data)
+{
+    g_main_context_invoke_full(NULL, G_PRIORITY_HIGH, alarm_critical_clock_changed_cb, NULL, NULL);
+}
+
+static AlarmScheduler* alarm_critical_scheduler_new(AlarmSchedulerClock clock)
+{
+    AlarmScheduler* scheduler;
+
+    if(alarm_critical.thread == NULL) {
+        alarm_critical.context = g_main_context_new();
+        alarm_critical.thread = g_thread_new("alarm-critical", alarm_critical_thread, NULL);
+    }
+
+    // Critical alarms are few
+    scheduler = alarm_scheduler_new_with_context(clock, ALARM_SCHEDULER_BACKEND_HEAP, alarm_critical.context, alarm_critical_dispatch, GINT_TO_POINTER(clock));
+
+    // The main thread may drop the alarms while they are being dispatched
+    alarm_scheduler_set_data_funcs(scheduler, (AlarmSchedulerRefFunc)g_object_ref, alarm_critical_unref);
+
+    if(clock == ALARM_SCHEDULER_CLOCK_REALTIME)
+        alarm_scheduler_set_clock_changed_func(scheduler, alarm_critical_clock_changed);
+
+    return scheduler;
+}
+
+/*
+ * }} Critical alarms
+ */
+
+/*
+ * The system time or time zone has been changed. Clock alarms that are
+ * still in the future may have been calculated against the wrong day, so
+ * recompute all of them in one go. Any that are now in the past will
+ * trigger as usual.
+ *
+ * Timers are not affected, but the stored projection of their deadline is.
+ */
+static void alarm_timer_recalculate(void)
+{
+    GPtrArray* entries;
+    GPtrArray* alarms;
+    const time_t now = time(NULL);
+
+    for(guint critical = FALSE; critical <= TRUE; critical++) {
+        AlarmScheduler** schedulers = alarm_schedulers[critical];
+
+        if(schedulers[ALARM_SCHEDULER_CLOCK_REALTIME] != NULL) {
+            entries = alarm_scheduler_get_entries(schedulers[ALARM_SCHEDULER_CLOCK_REALTIME]);
+            alarms = g_ptr_array_sized_new(entries->len);
+
+            for(guint i = 0; i < entries->len; i++) {
+                Alarm* alarm = ALARM(((AlarmSchedulerEntry*)g_ptr_array_index(entries, i))->data);
+                AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+                if(alarm->type != ALARM_TYPE_CLOCK || priv->snoozed || alarm->timestamp <= now)
+                    continue;
+
+                g_ptr_array_add(alarms, alarm);
+            }
+
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm: updating %u alarms", alarms->len);
+
+            alarm_update_timestamps(alarms);
+
+            g_ptr_array_free(alarms, TRUE);
+            g_ptr_array_free(entries, TRUE);
+        }
+
+        if(schedulers[ALARM_SCHEDULER_CLOCK_BOOTTIME] != NULL) {
+            entries = alarm_scheduler_get_entries(schedulers[ALARM_SCHEDULER_CLOCK_BOOTTIME]);
+
+            for(guint i = 0; i < entries->len; i++) {
+                Alarm* alarm = ALARM(((AlarmSchedulerEntry*)g_ptr_array_index(entries, i))->data);
+
+                alarm_timer_set_deadline(alarm, ALARM_PRIVATE(alarm)->deadline);
+            }
+
+            g_ptr_array_free(entries, TRUE);
+        }
+    }
+}
+
+/* Steps of the system time smaller than this are not worth recalculating for */
+#define ALARM_TIME_STEP_MIN (G_USEC_PER_SEC / 100)
+
+// Wall clock minus boot clock when the timers were last recalculated for a time change
+static gint64 alarm_timer_time_offset = 0;
+
+/*
+ * The main and the critical realtime scheduler both notice the same
+ * change of the system time, in no particular order. Only recalculate
+ * for whichever comes first.
+ */
+static void alarm_timer_time_changed(void)
+{
+    const gint64 offset = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_REALTIME) - alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+    if(ABS(offset - alarm_timer_time_offset) < ALARM_TIME_STEP_MIN)
+        return;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm: system time changed by %" G_GINT64_FORMAT "us", offset - alarm_timer_time_offset);
+
+    alarm_timer_time_offset = offset;
+    alarm_timer_recalculate();
+}
+
+static void alarm_timer_clock_changed(AlarmScheduler* scheduler, gpointer data)
+{
+    alarm_timer_time_changed();
+}
+
+static void alarm_timer_timezone_changed(gpointer data)
+{
+    alarm_timer_recalculate();
+}
+
+static AlarmScheduler* alarm_get_scheduler(AlarmSchedulerClock clock, gboolean critical)
+{
+    AlarmScheduler** schedulers = alarm_schedulers[critical != FALSE];
+
+    if(schedulers[clock] == NULL) {
+        if(critical)
+            schedulers[clock] = alarm_critical_scheduler_new(clock);
+        else
+            schedulers[clock] = alarm_scheduler_new(clock, alarm_timer_dispatch, GINT_TO_POINTER(clock));
+
+        if(alarm_timers_frozen > 0)
+            alarm_scheduler_freeze(schedulers[clock]);
+
+        if(clock == ALARM_SCHEDULER_CLOCK_REALTIME && !critical) {
+            alarm_catch_up_detect_jump();
+            alarm_scheduler_set_clock_changed_func(schedulers[clock], alarm_timer_clock_changed);
+            alarm_timezone_set_changed_func(alarm_timer_timezone_changed, NULL);
+        }
+    }
+
+    return schedulers[clock];
+}
+
+/*
+ * Hold off all timers, such as while loading alarms. Alarms can still be
+ * started, their timers are armed once thawed.
+ */
+void alarm_timers_freeze(void)
+{
+    if(alarm_timers_frozen++ > 0)
+        return;
+
+    for(guint critical = FALSE; critical <= TRUE; critical++) {
+        for(guint i = 0; i < G_N_ELEMENTS(alarm_schedulers[critical]); i++) {
+            if(alarm_schedulers[critical][i] != NULL)
+                alarm_scheduler_freeze(alarm_schedulers[critical][i]);
+        }
+    }
+}
+
+void alarm_timers_thaw(void)
+{
+    g_return_if_fail(alarm_timers_frozen > 0);
+
+    if(--alarm_timers_frozen > 0)
+        return;
+
+    for(guint critical = FALSE; critical <= TRUE; critical++) {
+        for(guint i = 0; i < G_N_ELEMENTS(alarm_schedulers[critical]); i++) {
+            if(alarm_schedulers[critical][i] != NULL)
+                alarm_scheduler_thaw(alarm_schedulers[critical][i]);
+        }
+    }
+}
+
+/*
+ * Timers count down on the boot clock, so that changes of the system time
+ * neither stretch nor shrink them, and time spent suspended still counts.
+ * Their timestamp is only a wall clock projection of the deadline, which
+ * is what gets stored.
+ */
+static void alarm_timer_set_deadline(Alarm* alarm, gint64 deadline)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    const gint64 remain = deadline - alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+    priv->deadline = deadline;
+
+    priv->deadline_sync = TRUE;
+    g_object_set(alarm, "timestamp", (g_get_real_time() + remain + G_USEC_PER_SEC / 2) / G_USEC_PER_SEC, NULL);
+    priv->deadline_sync = FALSE;
+}
+
+/*
+ * Move an interval timer on to its next deadline. The deadlines are
+ * counted from a fixed origin rather than from when the timer was
+ * dispatched, so that any latency doesn't add up over time.
+ *
+ * Intervals that have already passed are skipped, unless every missed
+ * occurrence should trigger, in which case they are due right away.
+ */
+static void alarm_timer_next_interval(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    const gint64 interval = MAX(alarm->time, 1) * G_USEC_PER_SEC;
+    const gint64 now = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+    // Loaded from settings, count from the stored deadline
+    if(priv->cycle == 0)
+        priv->origin = priv->deadline;
+
+    priv->snoozed = FALSE;
+    priv->cycle++;
+
+    if(alarm->catch_up != ALARM_CATCH_UP_ALL && priv->origin + (gint64)priv->cycle * interval <= now)
+        priv->cycle = (now - priv->origin) / interval + 1;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: next_interval() #%" G_GUINT64_FORMAT, alarm, alarm->id, priv->cycle);
+
+    alarm_timer_set_deadline(alarm, priv->origin + (gint64)priv->cycle * interval);
+}
+
+/*
+ * Derive the timer deadline from the timestamp
+ */
+static void alarm_timer_sync_deadline(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    const gint64 remain = (gint64)alarm->timestamp * G_USEC_PER_SEC - g_get_real_time();
+
+    priv->deadline = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME) + remain;
+}
+
+static void alarm_timer_start(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    AlarmScheduler* scheduler;
+    gint64 deadline;
+
+    if(priv->detached)
+        return;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: timer_start()", alarm, alarm->id);
+
+    if(alarm->type == ALARM_TYPE_TIMER) {
+        scheduler = alarm_get_scheduler(ALARM_SCHEDULER_CLOCK_BOOTTIME, alarm->critical);
+        deadline = priv->deadline;
+    } else {
+        scheduler = alarm_get_scheduler(ALARM_SCHEDULER_CLOCK_REALTIME, alarm->critical);
+        deadline = (gint64)alarm->timestamp * G_USEC_PER_SEC;
+    }
+
+    // The type has changed, move over to the other clock or scheduler
+    if(priv->timer_scheduler != scheduler)
+        alarm_timer_remove(alarm);
+
+    // This also moves the alarm if it is already scheduled
+    alarm_scheduler_add(scheduler, &priv->timer_entry, deadline);
+    priv->timer_scheduler = scheduler;
+}
+
+static gboolean alarm_timer_is_started(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    // The critical thread dequeues entries under the scheduler's lock
+    return priv->timer_scheduler && alarm_scheduler_is_queued(priv->timer_scheduler, &priv->timer_entry);
+}
+
+static void alarm_timer_remove(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    if(alarm_timer_is_started(alarm)) {
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: timer_remove", alarm, alarm->id);
+
+        alarm_scheduler_remove(priv->timer_scheduler, &priv->timer_entry);
+    }
+
+    priv->timer_scheduler = NULL;
+}
+
+/*
+ * Pause a running timer, keeping the remaining time
+ */
+void alarm_pause(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    g_return_if_fail(alarm->type == ALARM_TYPE_TIMER);
+
+    if(!alarm->active)
+        return;
+
+    const gint64 remain = priv->deadline - alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: pause() with %" G_GINT64_FORMAT "us left", alarm, alarm->id, remain);
+
+    // Stored, so that the timer can still be resumed after a restart
+    g_object_set(alarm, "active", FALSE, PROP_NAME_REMAINING, MAX(remain, 1), NULL);
+}
+
+/*
+ * Resume a paused timer where it left off
+ */
+void alarm_resume(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    g_return_if_fail(alarm->type == ALARM_TYPE_TIMER);
+
+    if(!alarm_is_paused(alarm))
+        return;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: resume()", alarm, alarm->id);
+
+    const gint64 deadline = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME) + priv->remaining;
+
+    // Intervals are shifted by the time spent paused
+    priv->origin += deadline - priv->deadline;
+
+    g_object_freeze_notify(G_OBJECT(alarm));
+    alarm_timer_set_deadline(alarm, deadline);
+    g_object_set(alarm, PROP_NAME_REMAINING, (gint64)0, "active", TRUE, NULL);
+    g_object_thaw_notify(G_OBJECT(alarm));
+}
+
+gboolean alarm_is_paused(Alarm* alarm)
+{
+    return ALARM_PRIVATE(alarm)->remaining > 0;
+}
+
+/*
+ * }} ALARM signal
+ */
+
+static GSettings* alarm_gsettings_new(guint id)
+{
+    gchar* dir = g_strdup_printf(ALARM_G_SETTINGS_BASE_DIR ALARM_G_SETTINGS_DIR_PREFIX "%u/", id);
+    GSettings* settings = g_settings_new_with_path("io.github.alarm-clock-applet.alarm", dir);
+
+    g_free(dir);
+
+    return settings;
+}
+
+static void alarm_gsettings_connect(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    // Binding sets every property, notify once for all of them
+    g_object_freeze_notify(G_OBJECT(alarm));
+
+    // g_settings_bind(priv->settings, PROP_NAME_TRIGGERED, alarm, PROP_NAME_TRIGGERED, G_SETTINGS_BIND_DEFAULT);
+    for(guint i = 0; alarm_stored_properties[i]; i++) {
+        if(!alarm_property_is_cold(alarm_stored_properties[i]))
+            g_settings_bind(priv->settings, alarm_stored_properties[i], alarm, alarm_stored_properties[i], G_SETTINGS_BIND_DEFAULT);
+    }
+
+    g_object_thaw_notify(G_OBJECT(alarm));
+}
+
+/*
+ * Read some keys of the alarm's own path once, without keeping them bound
+ */
+static void alarm_gsettings_read(Alarm* alarm, const gchar* const* names)
+{
+    GSettings* settings = alarm_gsettings_new(alarm->id);
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: reading from its path", alarm, alarm->id);
+
+    g_object_freeze_notify(G_OBJECT(alarm));
+
+    for(guint i = 0; names[i]; i++) {
+        g_settings_bind(settings, names[i], alarm, names[i], G_SETTINGS_BIND_GET | G_SETTINGS_BIND_GET_NO_CHANGES);
+        g_settings_unbind(alarm, names[i]);
+    }
+
+    g_object_thaw_notify(G_OBJECT(alarm));
+
+    g_object_unref(settings);
+}
+
+/*
+ * Read the cold properties, the first time any of them is used. Until
+ * then the strings are NULL.
+ */
+static void alarm_load_cold(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+    if(priv->cold_loaded || alarm->id == -1)
+        return;
+
+    // Setting them below comes back here
+    priv->cold_loaded = TRUE;
+
+    g_object_freeze_notify(G_OBJECT(alarm));
+
+    if(priv->settings) {
+        for(guint i = 0; alarm_cold_properties[i]; i++)
+            g_settings_bind(priv->settings, alarm_cold_properties[i], alarm, alarm_cold_properties[i], G_SETTINGS_BIND_DEFAULT);
+    } else if(!alarm_storage_load(alarm, TRUE)) {
+        alarm_gsettings_read(alarm, alarm_cold_properties);
+    }
+
+    g_object_thaw_notify(G_OBJECT(alarm));
+}
+
+gboolean alarm_property_is_cold(const gchar* name)
+{
+    return g_strv_contains(alarm_cold_properties, name);
+}
+
+gboolean alarm_is_cold_loaded(Alarm* alarm)
+{
+    return ALARM_PRIVATE(alarm)->cold_loaded;
+}
+
+const gchar* alarm_get_message(Alarm* alarm)
+{
+    alarm_load_cold(alarm);
+    return alarm->message;
+}
+
+const gchar* alarm_get_sound_file(Alarm* alarm)
+{
+    alarm_load_cold(alarm);
+    return alarm->sound_file;
+}
+
+const gchar* alarm_get_command(Alarm* alarm)
+{
+    alarm_load_cold(alarm);
+    return alarm->command;
+}
+
+/*
+ * Settings holding the alarm's current values, for reading keys. With
+ * packed storage the properties are bound into a delayed instance, which
+ * is dropped without being applied. Unref when done.
+ */
+static GSettings* alarm_gsettings_snapshot(Alarm* alarm)
+{
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    GSettings* settings;
+
+    if(priv->settings)
+        return g_object_ref(priv->settings);
+
+    alarm_load_cold(alarm);
+
+    settings = alarm_gsettings_new(alarm->id);
+    g_settings_delay(settings);
+
+    // Binding for setting only writes the current value right away
+    for(guint i = 0; alarm_stored_properties[i]; i++) {
+        g_settings_bind(settings, alarm_stored_properties[i], alarm, alarm_stored_properties[i], G_SETTINGS_BIND_SET);
+        g_settings_unbind(alarm, alarm_stored_properties[i]);
+    }
+
+    return settings;
+}
+
+static void alarm_storage_notify(GObject* object, GParamSpec* pspec, gpointer data)
+{
+    if(g_strv_contains(alarm_stored_properties, pspec->name))
+        alarm_storage_save(ALARM(object));
+}
+
+const gchar* const* alarm_get_stored_properties(void)
+{
+    return alarm_stored_properties;
+}
+
+static void alarm_dispose(GObject* object)
+{
+    Alarm* alarm = ALARM(object);
+    AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+    GObjectClass* parent = (GObjectClass*)alarm_parent_class;
+
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: dispose()", alarm, alarm->id);
+
+    if(parent->dispose)
+        parent->dispose(object);
+
+    g_clear_object(&priv->settings);
+    alarm_timer_remove(alarm);
+    alarm_clear(alarm);
+    g_queue_remove(&alarm_sound_waiting, alarm);
+    g_clear_pointer(&alarm->cron, g_free);
+    g_clear_pointer(&alarm->command, g_ref_string_release);
+    g_clear_pointer(&alarm->sound_file, g_ref_string_release);
+    g_clear_pointer(&alarm->message, g_ref_string_release);
+}
+
+// Called every time an alarm is created or deleted
+void alarm_update_gsettings_alarm_list(GSettings* settings, AlarmStore* store)
+{
+    const guint count = alarm_store_get_size(store);
+    guint32* newvalues = malloc(((size_t)count) * sizeof(guint32));
+    gsize i;
+    for(i = 0; i < count; i++) {
+        const Alarm* a = alarm_store_index(store, i);
+        newvalues[i] = a->id;
+    }
+
+    GVariant* v = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, newvalues, i, sizeof(guint32));
+    g_settings_set_value(settings, "alarms", v);
+    free(newvalues);
+}
+
+static void prop_repeat_notify(GObject* self, GParamSpec* pspec, gpointer user_data)
+{
+    alarm_applet_request_resize(user_data);
+}
+
+/*
+ * Convenience function for creating a new alarm instance.
+ * New ids are taken from the applet's AlarmStore, see alarm_store_gen_id().
+ */
+Alarm* alarm_new(struct _AlarmApplet* applet, guint id)
+{
+    Alarm* alarm = g_object_new(TYPE_ALARM, "id", id, NULL);
+
+    // Ask for a resize when a property has changed that might require more space
+    g_signal_connect(alarm, "notify::" PROP_NAME_REPEAT, G_CALLBACK(prop_repeat_notify), applet);
+
+    return alarm;
+}
+
+gchar* alarm_gsettings_get_dir(Alarm* alarm)
+{
+    gchar* key;
+
+    g_return_val_if_fail(IS_ALARM(alarm), NULL);
+
+    key = g_strdup_printf(ALARM_G_SETTINGS_BASE_DIR ALARM_G_SETTINGS_DIR_PREFIX "%d/", alarm->id);
+
+    return key;
+}
+
+/*
+ * Key files {{
+ */
+
+/*
+ * Put the values held back in settings into the packed key, through a
+ * detached alarm that converts them to properties
+ */
+static void alarm_import_packed(guint id, GSettings* settings)
+{
+    Alarm* alarm;
+    AlarmPrivate* priv;
+
+    alarm_construct_detached = TRUE;
+    alarm = g_object_new(TYPE_ALARM, "id", id, NULL);
+    alarm_construct_detached = FALSE;
+
+    // Keep the imported timestamp, as when loading
+    priv = ALARM_PRIVATE(alarm);
+    priv->loading = TRUE;
+
+    for(guint i = 0; alarm_stored_properties[i]; i++) {
+        g_settings_bind(settings, alarm_stored_properties[i], alarm, alarm_stored_properties[i], G_SETTINGS_BIND_GET | G_SETTINGS_BIND_GET_NO_CHANGES);
+        g_settings_unbind(alarm, alarm_stored_properties[i]);
+    }
+
+    priv->loading = FALSE;
+
+    alarm_storage_save(alarm);
+
+    g_object_unref(alarm);
+}
+
+/*
+ * Write a key file group into the settings of the alarm with the given id,
+ * before the alarm is created. Values are in GVariant text format, and
+ * missing keys keep their defaults. The settings are written in one
+ * transaction, or not at all if a value is invalid. With packed storage
+ * they go into the packed key instead, which is written once when idle.
+ */
+gboolean alarm_import_key_file(guint id, GKeyFile* keyfile, const gchar* group, GError** error)
+{
+    GSettings* settings = alarm_gsettings_new(id);
+    GSettingsSchema* schema;
+    gchar** keys;
+    gboolean ret = TRUE;
+
+    g_object_get(settings, "settings-schema", &schema, NULL);
+    keys = g_settings_schema_list_keys(schema);
+
+    g_settings_delay(settings);
+
+    for(guint i = 0; ret && keys[i]; i++) {
+        gchar* text = g_key_file_get_value(keyfile, group, keys[i], NULL);
+        if(!text)
+            continue;
+
+        GSettingsSchemaKey* key = g_settings_schema_get_key(schema, keys[i]);
+        GVariant* value = g_variant_parse(g_settings_schema_key_get_value_type(key), text, NULL, NULL, NULL);
+
+        if(value && g_settings_schema_key_range_check(key, value)) {
+            g_settings_set_value(settings, keys[i], value);
+        } else {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE, _("Invalid value for %s in [%s]: %s"), keys[i], group, text);
+            ret = FALSE;
+        }
+
+        if(value)
+            g_variant_unref(value);
+        g_settings_schema_key_unref(key);
+        g_free(text);
+    }
+
+    if(ret && alarm_storage_is_packed())
+        alarm_import_packed(id, settings);
+    else if(ret)
+        g_settings_apply(settings);
+
+    // Packed, the path is only used to parse the values
+    if(g_settings_get_has_unapplied(settings))
+        g_settings_revert(settings);
+
+    g_strfreev(keys);
+    g_settings_schema_unref(schema);
+    g_object_unref(settings);
+
+    return ret;
+}
+
+/*
+ * Write the settings of an alarm into a key file group
+ */
+void alarm_export_key_file(Alarm* alarm, GKeyFile* keyfile, const gchar* group)
+{
+    GSettings* settings = alarm_gsettings_snapshot(alarm);
+    GSettingsSchema* schema;
+    gchar** keys;
+
+    g_object_get(settings, "settings-schema", &schema, NULL);
+    keys = g_settings_schema_list_keys(schema);
+
+    for(guint i = 0; keys[i]; i++) {
+        GVariant* value = g_settings_get_value(settings, keys[i]);
+        gchar* text = g_variant_print(value, FALSE);
+
+        g_key_file_set_value(keyfile, group, keys[i], text);
+
+        g_free(text);
+        g_variant_unref(value);
+    }
+
+    g_strfreev(keys);
+    g_settings_schema_unref(schema);
+    g_object_unref(settings);
+}
+
+/*
+ * }} Key files
+ */
+
+/**
+ * Compare two alarms based on ID
+ */
+static gint alarm_list_item_compare(gconstpointer a, gconstpointer b)
+{
+    Alarm* a1 = ALARM(*(Alarm**)a);
+    Alarm* a2 = ALARM(*(Alarm**)b);
+
+    return a1->id - a2->id;
+}
+
+static GPtrArray* alarm_get_list_full(struct _AlarmApplet* applet, GSettings* settings, gboolean detached)
+{
+    GVariant* var = g_settings_get_value(settings, "alarms");
+    gsize count = 0;
     const guint32* values = g_variant_get_fixed_array(var, &count, sizeof(guint32));
+    GPtrArray* ret = g_ptr_array_new_full(count, g_object_unref);
 
     if(values) {
         for(guint32 i = 0; i < count; i++) {
             const guint32 id = values[i];
-            g_debug("Alarm: get_list() found #%" G_GUINT32_FORMAT, id);
+            alarm_log_debug(ALARM_LOG_ALARM, "Alarm: get_list() found #%" G_GUINT32_FORMAT, id);
 
-            Alarm* alarm = alarm_new(applet, settings, id);
+            Alarm* alarm;
+
+            if(detached) {
+                alarm_construct_detached = TRUE;
+                alarm = g_object_new(TYPE_ALARM, "id", id, NULL);
+                alarm_construct_detached = FALSE;
+            } else {
+                alarm = alarm_new(applet, id);
+            }
             //			g_debug ("\tref = %d", G_OBJECT (alarm)->ref_count);
-            ret = g_list_insert_sorted(ret, alarm, alarm_list_item_compare);
-            //			g_debug ("\tappend ref = %d", G_OBJECT (alarm)->ref_count);
+            g_ptr_array_add(ret, alarm);
         }
     }
     g_variant_unref(var);
 
+    g_ptr_array_sort(ret, alarm_list_item_compare);
+
     return ret;
 }
 
+/*
+ * Get list of alarms in gsettings, sorted by ID. The array holds a
+ * reference to each alarm.
+ */
+GPtrArray* alarm_get_list(struct _AlarmApplet* applet, GSettings* settings)
+{
+    return alarm_get_list_full(applet, settings, FALSE);
+}
+
+/*
+ * Like alarm_get_list(), but the alarms only hold their stored values.
+ * They are never scheduled, and changes to them are not written back.
+ * Storage has to be initialized first.
+ */
+GPtrArray* alarm_get_list_detached(GSettings* settings)
+{
+    return alarm_get_list_full(NULL, settings, TRUE);
+}
+
 /*
  * Connect a signal callback to all alarms in list.
  */
-void alarm_signal_connect_list(GList* instances, const gchar* detailed_signal, GCallback c_handler, gpointer data)
+void alarm_signal_connect_list(GPtrArray* instances, const gchar* detailed_signal, GCallback c_handler, gpointer data)
 {
-    GList* l;
     Alarm* a;
-    g_debug("Alarm: signal_connect_list()");
-    for(l = instances; l != NULL; l = l->next) {
-        a = ALARM(l->data);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm: signal_connect_list()");
+    for(guint i = 0; i < instances->len; i++) {
+        a = ALARM(g_ptr_array_index(instances, i));
 
-        g_debug("\tconnecting Alarm(%p) #%d: %s...", a, a->id, detailed_signal);
+        alarm_log_debug(ALARM_LOG_ALARM, "\tconnecting Alarm(%p) #%d: %s...", a, a->id, detailed_signal);
 
         g_signal_connect(a, detailed_signal, c_handler, data);
     }
@@ -872,7 +2122,7 @@ static void alarm_player_state_cb(MediaPlayer* player, MediaPlayerState state, g
     }
 
     if(state == MEDIA_PLAYER_STOPPED) {
-        g_debug("Alarm(%p) #%d: Freeing media player %p", alarm, alarm->id, player);
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: Freeing media player %p", alarm, alarm->id, player);
 
         media_player_free(player);
 
@@ -884,7 +2134,7 @@ static gboolean alarm_player_timeout(gpointer data)
 {
     Alarm* alarm = ALARM(data);
 
-    g_debug("Alarm(%p) #%d: player_timeout", alarm, alarm->id);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: player_timeout", alarm, alarm->id);
 
     alarm_player_stop(alarm);
 
@@ -900,19 +2150,19 @@ static void alarm_player_start(Alarm* alarm)
     AlarmPrivate* priv = ALARM_PRIVATE(alarm);
 
     if(priv->player == NULL) {
-        priv->player = media_player_new(alarm->sound_file, alarm->sound_loop, alarm_player_state_cb, alarm, alarm_player_error_cb, alarm);
+        priv->player = media_player_new(alarm_get_sound_file(alarm), alarm->sound_loop, alarm_player_state_cb, alarm, alarm_player_error_cb, alarm);
         if(priv->player == NULL) {
             // Unable to create player
             alarm_error_trigger(alarm, ALARM_ERROR_PLAY, _("Could not create player! Please check your sound settings."));
             return;
         }
     } else {
-        media_player_set_uri(priv->player, alarm->sound_file);
+        media_player_set_uri(priv->player, alarm_get_sound_file(alarm));
     }
 
     media_player_start(priv->player);
 
-    g_debug("Alarm(%p) #%d: player_start...", alarm, alarm->id);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: player_start...", alarm, alarm->id);
 
     /*
      * Add stop timeout
@@ -945,9 +2195,9 @@ static void alarm_command_run(Alarm* alarm)
     GError* err = NULL;
     gchar* msg;
 
-    if(!g_spawn_command_line_async(alarm->command, &err)) {
+    if(!g_spawn_command_line_async(alarm_get_command(alarm), &err)) {
 
-        msg = g_strdup_printf("Could not launch `%s': %s", alarm->command, err->message);
+        msg = g_strdup_printf("Could not launch `%s': %s", alarm_get_command(alarm), err->message);
 
         g_critical("%s", msg);
 
@@ -965,7 +2215,7 @@ static void alarm_command_run(Alarm* alarm)
  */
 void alarm_set_time(Alarm* alarm, guint hour, guint minute, guint second)
 {
-    g_debug("Alarm(%p) #%d: set_time (%d:%d:%d)", alarm, alarm->id, hour, minute, second);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: set_time (%d:%d:%d)", alarm, alarm->id, hour, minute, second);
 
     g_object_set(alarm, "time", second + minute * 60 + hour * 60 * 60, NULL);
 }
@@ -984,93 +2234,140 @@ gint alarm_wday_distance(gint wday1, gint wday2)
     return d;
 }
 
-static gboolean alarm_time_is_future(struct tm* tm, guint hour, guint minute, guint second)
+/*
+ * Distance in days from a weekday to the first day at or after it that is
+ * set in a repeat mask, indexed by [AlarmRepeat][wday]. Built at compile time.
+ */
+#define WDAY_IN(m, w, k) (((m) >> (((w) + (k)) % 7)) & 1)
+#define WDAY_DISTANCE(m, w)                                     \
+    (WDAY_IN(m, w, 0)   ? 0                                     \
+     : WDAY_IN(m, w, 1) ? 1                                     \
+     : WDAY_IN(m, w, 2) ? 2                                     \
+     : WDAY_IN(m, w, 3) ? 3                                     \
+     : WDAY_IN(m, w, 4) ? 4                                     \
+     : WDAY_IN(m, w, 5) ? 5                                     \
+     : WDAY_IN(m, w, 6) ? 6                                     \
+                        : 0)
+#define WDAY_ROW(m)                                                                                                             \
+    {                                                                                                                           \
+        WDAY_DISTANCE(m, 0), WDAY_DISTANCE(m, 1), WDAY_DISTANCE(m, 2), WDAY_DISTANCE(m, 3), WDAY_DISTANCE(m, 4), WDAY_DISTANCE(m, 5), \
+            WDAY_DISTANCE(m, 6)                                                                                                 \
+    }
+#define WDAY_ROWS8(m) \
+    WDAY_ROW(m), WDAY_ROW(m + 1), WDAY_ROW(m + 2), WDAY_ROW(m + 3), WDAY_ROW(m + 4), WDAY_ROW(m + 5), WDAY_ROW(m + 6), WDAY_ROW(m + 7)
+
+static const guint8 alarm_repeat_wday_distance[ALARM_REPEAT_ALL + 1][7] = {
+    WDAY_ROWS8(0),  WDAY_ROWS8(8),  WDAY_ROWS8(16), WDAY_ROWS8(24), WDAY_ROWS8(32),  WDAY_ROWS8(40),  WDAY_ROWS8(48),  WDAY_ROWS8(56),
+    WDAY_ROWS8(64), WDAY_ROWS8(72), WDAY_ROWS8(80), WDAY_ROWS8(88), WDAY_ROWS8(96), WDAY_ROWS8(104), WDAY_ROWS8(112), WDAY_ROWS8(120),
+};
+
+#undef WDAY_ROWS8
+#undef WDAY_ROW
+#undef WDAY_DISTANCE
+#undef WDAY_IN
+
+/*
+ * Local time shared by a run of timestamp calculations, so that updating
+ * many alarms only converts the current time once.
+ */
+typedef struct {
+    gint64 midnight; // Start of the local day, in local seconds since the epoch
+    guint wday;      // Day of the week, 0 is Sunday
+    guint second;    // Seconds since midnight
+} AlarmTimestampContext;
+
+static void alarm_timestamp_context_init(AlarmTimestampContext* ctx, gint64 now)
 {
-    return (hour > tm->tm_hour || (hour == tm->tm_hour && minute > tm->tm_min) || (hour == tm->tm_hour && minute == tm->tm_min && second > tm->tm_sec));
+    const gint64 day = 24 * 60 * 60;
+    const gint64 local = alarm_timezone_to_local(now);
+    gint64 days = local / day;
+
+    if(local % day < 0)
+        days--;
+
+    ctx->midnight = days * day;
+    ctx->second = local - ctx->midnight;
+    // 1970-01-01 was a Thursday
+    ctx->wday = (days % 7 + 7 + 4) % 7;
 }
 
+/*
+ * Next occurrence of hour:minute:second on one of the repeat days.
+ * Without a repeat, this is today or tomorrow.
+ */
+static time_t alarm_timestamp_next(AlarmTimestampContext* ctx, AlarmRepeat repeat, guint hour, guint minute, guint second)
+{
+    const guint mask = (repeat & ALARM_REPEAT_ALL) ? (repeat & ALARM_REPEAT_ALL) : ALARM_REPEAT_ALL;
+    const guint time_of_day = hour * 60 * 60 + minute * 60 + second;
+    guint d;
+
+    d = alarm_repeat_wday_distance[mask][ctx->wday];
+    if(d == 0 && time_of_day <= ctx->second)
+        d = 1 + alarm_repeat_wday_distance[mask][(ctx->wday + 1) % 7];
+
+    return alarm_timezone_from_local(ctx->midnight + (gint64)d * 24 * 60 * 60 + time_of_day);
+}
 
 /*
  * Set time according to hour, min, sec and alarm->repeat
  */
 static void alarm_set_timestamp(Alarm* alarm, guint hour, guint minute, guint second)
 {
-    time_t now, new;
-    gint i, d, wday;
-    AlarmRepeat rep;
-    struct tm tm;
+    AlarmTimestampContext ctx;
+    time_t new;
 
-    g_debug("Alarm(%p) #%d: set_timestamp (%d, %d, %d)", alarm, alarm->id, hour, minute, second);
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: set_timestamp (%d, %d, %d)", alarm, alarm->id, hour, minute, second);
 
-    time(&now);
-    tzset();
-    if(!localtime_r(&now, &tm)) {
-        memset(&tm, 0, sizeof(tm));
-        g_critical("Alarm #%d: localtime failed", alarm->id);
-    }
+    alarm_timestamp_context_init(&ctx, time(NULL));
 
-    // Automatically detect Daylight Savings Time (DST)
-    tm.tm_isdst = -1;
+    new = alarm_timestamp_next(&ctx, alarm->repeat, hour, minute, second);
+    alarm_log_debug(ALARM_LOG_ALARM, "\tSetting to %d", (gint) new);
+    g_object_set(alarm, "timestamp", new, NULL);
+}
 
-    if(alarm->repeat == ALARM_REPEAT_NONE) {
-        // Check if the alarm is for tomorrow
-        if(!alarm_time_is_future(&tm, hour, minute, second)) {
-            g_debug("\tAlarm is for tomorrow.");
-            tm.tm_mday++;
-        }
-    } else {
-        // REPEAT SET: Find the closest repeat day
-        wday = -1;
+/*
+ * Set the timestamp to the next match of the cron expression
+ */
+static void alarm_set_timestamp_cron(Alarm* alarm, gint64 now)
+{
+    const gint64 next = alarm_cron_next(&ALARM_PRIVATE(alarm)->cron, now);
 
-        i = tm.tm_wday;
+    if(next < 0) {
+        g_warning("Alarm(%p) #%d: Cron expression '%s' never matches", alarm, alarm->id, alarm->cron);
+        alarm_disable(alarm);
+        return;
+    }
 
-        // Try finding a day in this week
-        for(; i < 7; i++) {
-            rep = 1 << i;
-            if(alarm->repeat & rep) {
-                if(i == tm.tm_wday && !alarm_time_is_future(&tm, hour, minute, second))
-                    continue;
-                wday = i;
-                break;
-            }
-        }
+    alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: set_timestamp_cron: %" G_GINT64_FORMAT, alarm, alarm->id, next);
+    g_object_set(alarm, "timestamp", next, NULL);
+}
 
-        // If we haven't found a day in the current week, check next week
-        if(wday == -1) {
-            for(i = 0; i <= tm.tm_wday; i++) {
-                rep = 1 << i;
-                if(alarm->repeat & rep) {
-                    wday = i;
-                    break;
-                }
-            }
-        }
+/*
+ * First occurrence of the alarm time after the given time, on one of
+ * the repeat days. Without a repeat, this is on the same or the next day.
+ * Alarms with a cron expression return the next match, or -1 if there
+ * is none. Interval timers return the next interval after the timestamp.
+ */
+gint64 alarm_get_next_occurrence(Alarm* alarm, gint64 after)
+{
+    AlarmTimestampContext ctx;
+    const guint secs = alarm->time % (24 * 60 * 60);
 
-        g_debug("Closest WDAY = %d", wday);
+    if(alarm->type == ALARM_TYPE_TIMER) {
+        const gint64 interval = MAX(alarm->time, 1);
 
-        if(wday == tm.tm_wday && (!alarm_time_is_future(&tm, hour, minute, second)))
-            wday = 7;
+        if(after < alarm->timestamp)
+            return alarm->timestamp;
 
-        // Calculate distance from now to wday
-        if(wday == 7) {
-            g_debug("\tAlarm is in (forced) 1 week.");
-            d = 7;
-        } else {
-            d = alarm_wday_distance(tm.tm_wday, wday);
-        }
-
-        g_debug("\tAlarm is in %d days.", d);
-
-        tm.tm_mday += d;
+        return alarm->timestamp + ((after - alarm->timestamp) / interval + 1) * interval;
     }
 
-    tm.tm_hour = hour;
-    tm.tm_min = minute;
-    tm.tm_sec = second;
+    if(ALARM_PRIVATE(alarm)->has_cron)
+        return alarm_cron_next(&ALARM_PRIVATE(alarm)->cron, after);
 
-    new = mktime(&tm);
-    g_debug("\tSetting to %d", (gint) new);
-    g_object_set(alarm, "timestamp", new, NULL);
+    alarm_timestamp_context_init(&ctx, after);
+
+    return alarm_timestamp_next(&ctx, alarm->repeat, secs / 3600, secs / 60 % 60, secs % 60);
 }
 
 /*
@@ -1079,20 +2376,51 @@ static void alarm_set_timestamp(Alarm* alarm, guint hour, guint minute, guint se
  */
 void alarm_update_timestamp(Alarm* alarm)
 {
-    if(alarm->type == ALARM_TYPE_CLOCK) {
+    ALARM_PRIVATE(alarm)->snoozed = FALSE;
+
+    if(alarm->type == ALARM_TYPE_CLOCK && ALARM_PRIVATE(alarm)->has_cron) {
+        alarm_set_timestamp_cron(alarm, time(NULL));
+    } else if(alarm->type == ALARM_TYPE_CLOCK) {
         struct tm tm;
         alarm_get_time(alarm, &tm);
-        g_debug("Alarm(%p) #%d: update_timestamp_full: %d:%d:%d", alarm, alarm->id, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        alarm_log_debug(ALARM_LOG_ALARM, "Alarm(%p) #%d: update_timestamp_full: %d:%d:%d", alarm, alarm->id, tm.tm_hour, tm.tm_min, tm.tm_sec);
         alarm_set_timestamp(alarm, tm.tm_hour, tm.tm_min, tm.tm_sec);
     } else {
         /* ALARM_TYPE_TIMER */
-        g_object_set(alarm, "timestamp", time(NULL) + alarm->time, NULL);
+        AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+
+        alarm_clear_remaining(alarm);
+        priv->origin = alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+        priv->cycle = 1;
+        alarm_timer_set_deadline(alarm, priv->origin + (gint64)alarm->time * G_USEC_PER_SEC);
     }
 }
 
 /*
- * Get the alarm time.
+ * Update the timestamps of many alarms at once, such as after a time zone
+ * change or resume. The current local time is only looked up once.
  */
+void alarm_update_timestamps(GPtrArray* alarms)
+{
+    AlarmTimestampContext ctx;
+
+    alarm_timestamp_context_init(&ctx, time(NULL));
+
+    for(guint i = 0; i < alarms->len; i++) {
+        Alarm* alarm = ALARM(g_ptr_array_index(alarms, i));
+
+        if(alarm->type != ALARM_TYPE_CLOCK || ALARM_PRIVATE(alarm)->has_cron) {
+            alarm_update_timestamp(alarm);
+            continue;
+        }
+
+        const guint secs = alarm->time % (24 * 60 * 60);
+
+        ALARM_PRIVATE(alarm)->snoozed = FALSE;
+        g_object_set(alarm, "timestamp", alarm_timestamp_next(&ctx, alarm->repeat, secs / 3600, secs / 60 % 60, secs % 60), NULL);
+    }
+}
+
 void alarm_get_time(Alarm* alarm, struct tm* res)
 {
     g_assert(res != NULL);
@@ -1110,8 +2438,7 @@ void alarm_get_remain(Alarm* alarm, struct tm* res)
 {
     g_assert(res != NULL);
 
-    const time_t now = time(NULL);
-    res->tm_sec = alarm->timestamp - now;
+    res->tm_sec = alarm_get_remain_seconds(alarm);
 
     res->tm_min = res->tm_sec / 60;
     res->tm_sec -= res->tm_min * 60;
@@ -1125,6 +2452,20 @@ void alarm_get_remain(Alarm* alarm, struct tm* res)
  */
 time_t alarm_get_remain_seconds(Alarm* alarm)
 {
+    if(alarm->type == ALARM_TYPE_TIMER) {
+        AlarmPrivate* priv = ALARM_PRIVATE(alarm);
+        gint64 remain = priv->remaining;
+
+        if(remain == 0)
+            remain = priv->deadline - alarm_scheduler_clock_get_time(ALARM_SCHEDULER_CLOCK_BOOTTIME);
+
+        // Round up, so that the countdown reaches zero when the timer is due
+        if(remain > 0)
+            remain += G_USEC_PER_SEC - 1;
+
+        return remain / G_USEC_PER_SEC;
+    }
+
     time_t now = time(NULL);
 
     return alarm->timestamp - now;
@@ -1178,9 +2519,17 @@ GSList* alarm_repeat_to_list(AlarmRepeat repeat)
     return list;
 }
 
+gboolean alarm_has_cron(Alarm* alarm)
+{
+    return ALARM_PRIVATE(alarm)->has_cron;
+}
+
 gboolean alarm_should_repeat(Alarm* alarm)
 {
-    return alarm->type == ALARM_TYPE_CLOCK && alarm->repeat != ALARM_REPEAT_NONE;
+    if(alarm->type == ALARM_TYPE_TIMER)
+        return alarm->interval;
+
+    return alarm->type == ALARM_TYPE_CLOCK && (alarm->repeat != ALARM_REPEAT_NONE || ALARM_PRIVATE(alarm)->has_cron);
 }
 
 /*
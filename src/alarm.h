@@ -19,6 +19,7 @@
 G_BEGIN_DECLS
 
 struct _AlarmApplet;
+struct _AlarmStore;
 
 /*
  * Utility macros
@@ -46,6 +47,31 @@ struct _AlarmApplet;
 #define ALARM_REPEAT_WEEKENDS (ALARM_REPEAT_SAT | ALARM_REPEAT_SUN)
 #define ALARM_REPEAT_ALL      (ALARM_REPEAT_WEEKDAYS | ALARM_REPEAT_WEEKENDS)
 
+/*
+ * One bit per property, collected by the store whenever it is set, so
+ * that consumers only redo what depends on it. See alarm_store_take_dirty().
+ */
+typedef enum {
+    ALARM_DIRTY_TRIGGERED   = 1 << 0,
+    ALARM_DIRTY_TYPE        = 1 << 1,
+    ALARM_DIRTY_TIME        = 1 << 2,
+    ALARM_DIRTY_TIMESTAMP   = 1 << 3,
+    ALARM_DIRTY_ACTIVE      = 1 << 4,
+    ALARM_DIRTY_MESSAGE     = 1 << 5,
+    ALARM_DIRTY_REPEAT      = 1 << 6,
+    ALARM_DIRTY_NOTIFY_TYPE = 1 << 7,
+    ALARM_DIRTY_SOUND_FILE  = 1 << 8,
+    ALARM_DIRTY_SOUND_LOOP  = 1 << 9,
+    ALARM_DIRTY_COMMAND     = 1 << 10,
+    ALARM_DIRTY_CRON        = 1 << 11,
+    ALARM_DIRTY_INTERVAL    = 1 << 12,
+    ALARM_DIRTY_CATCH_UP    = 1 << 13,
+    ALARM_DIRTY_CRITICAL    = 1 << 14,
+    ALARM_DIRTY_REMAINING   = 1 << 15,
+} AlarmDirtyFlags;
+
+#define ALARM_DIRTY_ALL ((AlarmDirtyFlags)((1 << 16) - 1))
+
 typedef struct _Alarm Alarm;
 typedef struct _AlarmClass AlarmClass;
 
@@ -61,15 +87,19 @@ struct _Alarm {
     time_t time;      /* Time for alarm */
     time_t timestamp; /* UNIX timestamp (local time) for running alarms */
     gboolean active;
-    gchar* message;
+    gchar* message; /* Interned, read on first use, see alarm_get_message() */
     AlarmRepeat repeat;
 
     AlarmNotifyType notify_type;
-    gchar* sound_file;
+    gchar* sound_file; /* Interned, read on first use, see alarm_get_sound_file() */
     gboolean sound_loop;
-    gchar* command;
+    gchar* command; /* Interned, read on first use, see alarm_get_command() */
+    gchar* cron; /* Cron expression, repeats the alarm instead of repeat when set */
+    gboolean interval;     /* Timer repeats every time seconds */
+    AlarmCatchUp catch_up; /* What to do about missed occurrences */
+    gboolean critical;     /* Scheduled apart from the UI, see alarm_critical_dispatch() */
 
-    gboolean changed; // Set to TRUE when a property has been changed to request a UI update
+    struct _AlarmStore* store; /* Store mirroring the timestamp and flags, and collecting dirty properties */
 };
 
 struct _AlarmClass {
@@ -109,6 +139,11 @@ typedef enum {
 #define ALARM_DEFAULT_SOUND_FILE  "" // Should default to first in stock sound list
 #define ALARM_DEFAULT_SOUND_LOOP  TRUE
 #define ALARM_DEFAULT_COMMAND     "" // Should default to first in app list
+#define ALARM_DEFAULT_CRON        ""
+#define ALARM_DEFAULT_INTERVAL    FALSE
+#define ALARM_DEFAULT_CATCH_UP    ALARM_CATCH_UP_ONCE
+#define ALARM_DEFAULT_CRITICAL    FALSE
+#define ALARM_DEFAULT_REMAINING   0
 
 /*
  * GConf settings
@@ -130,12 +165,35 @@ typedef enum {
 /* used by ALARM_TYPE */
 GType alarm_get_type(void);
 
-Alarm* alarm_new(struct _AlarmApplet* applet, GSettings* settings, gint id);
-
-guint alarm_gen_id(GSettings* settings);
+Alarm* alarm_new(struct _AlarmApplet* applet, guint id);
 
 gchar* alarm_gsettings_get_dir(Alarm* alarm);
 
+/*
+ * Names of the properties that are kept in the settings, NULL terminated
+ */
+const gchar* const* alarm_get_stored_properties(void);
+
+/*
+ * The message, sound file and command aren't needed for scheduling, so
+ * they are only read from the settings when first used. Read them through
+ * these instead of the fields. The strings are interned, so alarms with
+ * equal values return the same pointer.
+ */
+gboolean alarm_property_is_cold(const gchar* name);
+
+gboolean alarm_is_cold_loaded(Alarm* alarm);
+
+const gchar* alarm_get_message(Alarm* alarm);
+
+const gchar* alarm_get_sound_file(Alarm* alarm);
+
+const gchar* alarm_get_command(Alarm* alarm);
+
+gboolean alarm_import_key_file(guint id, GKeyFile* keyfile, const gchar* group, GError** error);
+
+void alarm_export_key_file(Alarm* alarm, GKeyFile* keyfile, const gchar* group);
+
 const gchar* alarm_type_to_string(AlarmType type);
 
 AlarmType alarm_type_from_string(const gchar* type);
@@ -145,12 +203,32 @@ const gchar* alarm_notify_type_to_string(AlarmNotifyType type);
 
 AlarmNotifyType alarm_notify_type_from_string(const gchar* type);
 
-GList* alarm_get_list(struct _AlarmApplet* applet, GSettings* settings);
+GPtrArray* alarm_get_list(struct _AlarmApplet* applet, GSettings* settings);
 
-void alarm_signal_connect_list(GList* instances, const gchar* detailed_signal, GCallback c_handler, gpointer data);
+GPtrArray* alarm_get_list_detached(GSettings* settings);
+
+void alarm_signal_connect_list(GPtrArray* instances, const gchar* detailed_signal, GCallback c_handler, gpointer data);
+
+/*
+ * Called once for every batch of alarms triggered together. counts holds
+ * the number of occurrences caught up on for each alarm, or is NULL if
+ * each triggered once. missed is set for alarms that were due while the
+ * applet wasn't running.
+ */
+typedef void (*AlarmTriggeredFunc)(GPtrArray* alarms, const guint* counts, gboolean missed, gpointer data);
+
+void alarm_set_triggered_func(AlarmTriggeredFunc func, gpointer data);
 
 void alarm_trigger(Alarm* alarm);
 
+void alarm_trigger_batch(GPtrArray* alarms);
+
+void alarm_timers_freeze(void);
+
+void alarm_timers_thaw(void);
+
+void alarm_reconcile(struct _AlarmStore* store);
+
 void alarm_set_enabled(Alarm* alarm, gboolean enabled);
 
 void alarm_enable(Alarm* alarm);
@@ -165,14 +243,24 @@ void alarm_unref(Alarm* alarm);
 
 void alarm_snooze(Alarm* alarm, guint seconds);
 
+void alarm_pause(Alarm* alarm);
+
+void alarm_resume(Alarm* alarm);
+
+gboolean alarm_is_paused(Alarm* alarm);
+
 gboolean alarm_is_playing(Alarm* alarm);
 
-void alarm_update_gsettings_alarm_list(GSettings* settings, GList* alarms);
+void alarm_update_gsettings_alarm_list(GSettings* settings, struct _AlarmStore* store);
 
 void alarm_set_time(Alarm* alarm, guint hour, guint minute, guint second);
 
 void alarm_update_timestamp(Alarm* alarm);
 
+void alarm_update_timestamps(GPtrArray* alarms);
+
+gint64 alarm_get_next_occurrence(Alarm* alarm, gint64 after);
+
 void alarm_update_timestamp_full(Alarm* alarm, gboolean include_today);
 
 GQuark alarm_error_quark(void);
@@ -191,6 +279,11 @@ AlarmRepeat alarm_repeat_from_list(GSList* list);
 GSList* alarm_repeat_to_list(AlarmRepeat repeat);
 gint alarm_wday_distance(gint wday1, gint wday2);
 gboolean alarm_should_repeat(Alarm* alarm);
+
+/*
+ * Whether the alarm repeats by its cron expression, which has to be valid
+ */
+gboolean alarm_has_cron(Alarm* alarm);
 gchar* alarm_repeat_to_pretty(AlarmRepeat repeat);
 
 
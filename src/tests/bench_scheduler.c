@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench_scheduler.c -- Benchmark of the alarm scheduler backends
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <glib.h>
+
+#include "alarm-scheduler.h"
+
+#define DAY (G_GINT64_CONSTANT(24) * 60 * 60 * G_USEC_PER_SEC)
+
+typedef struct {
+    guint fired;
+} Bench;
+
+static void bench_dispatch(AlarmScheduler* scheduler, GPtrArray* due, gint64 deadline, gpointer data)
+{
+    Bench* bench = data;
+
+    bench->fired += due->len;
+}
+
+static gdouble bench_elapsed(gint64 start, guint n)
+{
+    // Nanoseconds per operation
+    return (gdouble)(g_get_monotonic_time() - start) * 1000 / n;
+}
+
+static void bench_run(AlarmSchedulerBackend backend, const gchar* name, guint n)
+{
+    AlarmSchedulerEntry* entries = g_new0(AlarmSchedulerEntry, n);
+    Bench bench = { 0 };
+    AlarmScheduler* scheduler = alarm_scheduler_new_full(ALARM_SCHEDULER_CLOCK_REALTIME, backend, bench_dispatch, &bench);
+    const gint64 now = g_get_real_time();
+    GRand* rand = g_rand_new_with_seed(n);
+    gint64 start;
+
+    // Queue alarms spread over a week
+    start = g_get_monotonic_time();
+    for(guint i = 0; i < n; i++)
+        alarm_scheduler_add(scheduler, &entries[i], now + DAY / 24 + (gint64)g_rand_double_range(rand, 0, 7 * DAY));
+    const gdouble add = bench_elapsed(start, n);
+
+    // Re-arm each for the next day, as repeating alarms do
+    start = g_get_monotonic_time();
+    for(guint i = 0; i < n; i++)
+        alarm_scheduler_add(scheduler, &entries[i], entries[i].deadline + DAY);
+    const gdouble rearm = bench_elapsed(start, n);
+
+    // Cancel all of them
+    start = g_get_monotonic_time();
+    for(guint i = 0; i < n; i++)
+        alarm_scheduler_remove(scheduler, &entries[i]);
+    const gdouble cancel = bench_elapsed(start, n);
+
+    // Let all of them become due, then time dispatching them
+    for(guint i = 0; i < n; i++)
+        alarm_scheduler_add(scheduler, &entries[i], g_get_real_time() + g_rand_int_range(rand, 0, 20000));
+
+    g_usleep(50000);
+
+    start = g_get_monotonic_time();
+    while(bench.fired < n)
+        g_main_context_iteration(NULL, TRUE);
+    const gdouble fire = bench_elapsed(start, n);
+
+    g_print("%-6s %7u %10.1f %10.1f %10.1f %10.1f\n", name, n, add, rearm, cancel, fire);
+
+    alarm_scheduler_free(scheduler);
+    g_rand_free(rand);
+    g_free(entries);
+}
+
+int main(void)
+{
+    const guint sizes[] = { 1000, 10000, 100000 };
+
+    g_print("%-6s %7s %10s %10s %10s %10s\n", "", "alarms", "add", "re-arm", "cancel", "fire");
+    g_print("(ns per alarm)\n");
+
+    for(guint i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        bench_run(ALARM_SCHEDULER_BACKEND_HEAP, "heap", sizes[i]);
+        bench_run(ALARM_SCHEDULER_BACKEND_WHEEL, "wheel", sizes[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * test_cron.c -- Test of the cron expression recurrence
+ *
+ * Copyright (C) 2022 Tasos Sahanidis <code@tasossah.com>
+ */
+
+#include <glib.h>
+
+#include "alarm-cron.h"
+
+/* Central European Time, without depending on the installed zoneinfo */
+#define TZ_CET "CET-1CEST,M3.5.0,M10.5.0/3"
+
+static gint64 test_utc(gint y, gint m, gint d, gint h, gint min)
+{
+    GDateTime* dt = g_date_time_new_utc(y, m, d, h, min, 0);
+    const gint64 ret = g_date_time_to_unix(dt);
+
+    g_date_time_unref(dt);
+
+    return ret;
+}
+
+static gint64 test_next(const gchar* expr, gint64 after)
+{
+    AlarmCron cron;
+
+    g_assert_true(alarm_cron_parse(expr, &cron));
+
+    return alarm_cron_next(&cron, after);
+}
+
+static void test_parse_invalid(void)
+{
+    static const gchar* const exprs[] = {
+        "",
+        "* * * *",
+        "* * * * * *",
+        "1- * * * *",
+        "-1 * * * *",
+        "*/0 * * * *",
+        "60 * * * *",
+        "* 24 * * *",
+        "* * 0 * *",
+        "* * 32 * *",
+        "* * * 13 *",
+        "* * * * 8",
+        "5-1 * * * *",
+        "4294967296 * * * *",
+        "99999999999999999999999 * * * *",
+        "*/4294967297 * * * *",
+        "* * * foo *",
+        "@sometimes",
+    };
+    AlarmCron cron;
+
+    for(guint i = 0; i < G_N_ELEMENTS(exprs); i++) {
+        if(alarm_cron_parse(exprs[i], &cron))
+            g_test_message("'%s' should be rejected", exprs[i]);
+        g_assert_false(alarm_cron_parse(exprs[i], &cron));
+    }
+}
+
+static void test_parse_valid(void)
+{
+    AlarmCron cron;
+
+    g_assert_true(alarm_cron_parse("*/15 9-17 * jan-mar mon-fri", &cron));
+    g_assert_cmphex(cron.minutes, ==, (1 << 0) | (1 << 15) | (1 << 30) | (G_GUINT64_CONSTANT(1) << 45));
+    g_assert_cmphex(cron.hours, ==, 0x3fe00);
+    g_assert_cmphex(cron.months, ==, 0xe);
+    g_assert_cmphex(cron.wdays, ==, 0x3e);
+    g_assert_true(cron.mday_any);
+    g_assert_false(cron.wday_any);
+
+    g_assert_true(alarm_cron_parse("  0   0\t1 1 *  ", &cron));
+    g_assert_true(alarm_cron_parse("@YEARLY", &cron));
+    g_assert_cmphex(cron.mdays, ==, 1 << 1);
+    g_assert_cmphex(cron.months, ==, 1 << 1);
+}
+
+static void test_sunday(void)
+{
+    AlarmCron cron;
+    // A Saturday
+    const gint64 after = test_utc(2022, 1, 1, 12, 0);
+
+    g_assert_true(alarm_cron_parse("0 0 * * 7", &cron));
+    g_assert_cmphex(cron.wdays, ==, 1 << 0);
+    g_assert_cmpint(alarm_cron_next(&cron, after), ==, test_utc(2022, 1, 2, 0, 0));
+
+    g_assert_cmpint(test_next("0 0 * * sun", after), ==, test_utc(2022, 1, 2, 0, 0));
+    g_assert_cmpint(test_next("0 0 * * 5-7", after), ==, test_utc(2022, 1, 2, 0, 0));
+}
+
+static void test_day_or_and(void)
+{
+    const gint64 after = test_utc(2022, 1, 1, 12, 0);
+
+    // Both restricted: either one matches, the 13th or a Friday
+    g_assert_cmpint(test_next("0 0 13 * 5", after), ==, test_utc(2022, 1, 7, 0, 0));
+    g_assert_cmpint(test_next("0 0 13 * 5", test_utc(2022, 1, 7, 0, 0)), ==, test_utc(2022, 1, 13, 0, 0));
+
+    // One of them '*': only the other one counts
+    g_assert_cmpint(test_next("0 0 13 * *", after), ==, test_utc(2022, 1, 13, 0, 0));
+    g_assert_cmpint(test_next("0 0 * * 5", after), ==, test_utc(2022, 1, 7, 0, 0));
+
+    // Starting with '*' counts as unrestricted, so both have to match: an
+    // odd day that is a Friday
+    g_assert_cmpint(test_next("0 0 */2 * 5", after), ==, test_utc(2022, 1, 7, 0, 0));
+    g_assert_cmpint(test_next("0 0 */2 * 5", test_utc(2022, 1, 7, 0, 0)), ==, test_utc(2022, 1, 21, 0, 0));
+}
+
+static void test_feb29(void)
+{
+    AlarmCron cron;
+    const gint64 after = test_utc(2022, 3, 1, 0, 0);
+
+    g_assert_cmpint(test_next("0 0 29 2 *", after), ==, test_utc(2024, 2, 29, 0, 0));
+    g_assert_cmpint(test_next("0 0 29 2 *", test_utc(2024, 2, 29, 0, 0)), ==, test_utc(2028, 2, 29, 0, 0));
+
+    // Never
+    g_assert_true(alarm_cron_parse("0 0 30 2 *", &cron));
+    g_assert_cmpint(alarm_cron_next(&cron, after), ==, -1);
+}
+
+static void test_dst_gap(void)
+{
+    g_setenv("TZ", TZ_CET, TRUE);
+
+    // 02:30 is skipped on 2022-03-27, moved forward to 03:30 CEST
+    g_assert_cmpint(test_next("30 2 * * *", test_utc(2022, 3, 26, 12, 0)), ==, test_utc(2022, 3, 27, 1, 30));
+    g_assert_cmpint(test_next("30 2 * * *", test_utc(2022, 3, 27, 1, 30)), ==, test_utc(2022, 3, 28, 0, 30));
+
+    g_setenv("TZ", "UTC", TRUE);
+}
+
+static void test_dst_repeat(void)
+{
+    g_setenv("TZ", TZ_CET, TRUE);
+
+    // 02:30 happens twice on 2022-10-30, only the first one (CEST) matches
+    g_assert_cmpint(test_next("30 2 * * *", test_utc(2022, 10, 29, 12, 0)), ==, test_utc(2022, 10, 30, 0, 30));
+    g_assert_cmpint(test_next("30 2 * * *", test_utc(2022, 10, 30, 0, 30)), ==, test_utc(2022, 10, 31, 1, 30));
+
+    g_setenv("TZ", "UTC", TRUE);
+}
+
+int main(int argc, char** argv)
+{
+    g_setenv("TZ", "UTC", TRUE);
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/cron/parse/invalid", test_parse_invalid);
+    g_test_add_func("/cron/parse/valid", test_parse_valid);
+    g_test_add_func("/cron/next/sunday", test_sunday);
+    g_test_add_func("/cron/next/day-or-and", test_day_or_and);
+    g_test_add_func("/cron/next/feb29", test_feb29);
+    g_test_add_func("/cron/next/dst-gap", test_dst_gap);
+    g_test_add_func("/cron/next/dst-repeat", test_dst_repeat);
+
+    return g_test_run();
+}
@@ -149,9 +149,7 @@ void alarm_applet_notification_show(AlarmApplet* applet, const gchar* summary, c
 
 void alarm_applet_label_update(AlarmApplet* applet)
 {
-    GList* l;
-    Alarm* a;
-    Alarm* next_alarm = NULL;
+    Alarm* next_alarm;
     struct tm tm;
     gchar* tmp;
 
@@ -171,15 +169,7 @@ void alarm_applet_label_update(AlarmApplet* applet)
     //
     // Show countdown
     //
-    for(l = applet->alarms; l; l = l->next) {
-        a = ALARM(l->data);
-        if(!a->active)
-            continue;
-
-        if(!next_alarm || a->timestamp < next_alarm->timestamp) {
-            next_alarm = a;
-        }
-    }
+    next_alarm = alarm_store_get_next_active(applet->alarms);
 
     if(!next_alarm) {
         // No upcoming alarms
@@ -338,55 +328,128 @@ void media_player_error_cb(MediaPlayer* player, GError* err, gpointer data)
 
 
 /**
- * Alarm changed signal handler
- *
- * Here we update any actions/views, if necessary
+ * Update any actions/views for the alarms changed since the last time
  */
-void alarm_applet_alarm_changed(GObject* object, GParamSpec* pspec, gpointer data)
+static gboolean alarm_applet_alarms_changed_idle(gpointer data)
 {
     AlarmApplet* applet = (AlarmApplet*)data;
-    Alarm* alarm = ALARM(object);
-    const gchar* pname = pspec->name;
+    GHashTableIter iter;
+    gpointer key;
+
+    applet->changed_id = 0;
 
-    g_debug("AlarmApplet: Alarm '%s' %s changed", alarm->message, pname);
+    g_debug("AlarmApplet: %u alarms changed", g_hash_table_size(applet->changed_alarms));
 
     // Update Actions
-    if(g_strcmp0(pname, "active") == 0) {
+    if(applet->changed_active) {
+        applet->changed_active = FALSE;
         alarm_action_update_enabled(applet);
     }
 
-    // Update List Window
+    // Update List Window, only the columns of the dirty properties
     if(applet->list_window && gtk_widget_get_visible(GTK_WIDGET(applet->list_window->window))) {
-        // Should really check that the changed param is relevant...
-        alarm_list_window_alarm_update(applet->list_window, alarm);
+        g_hash_table_iter_init(&iter, applet->changed_alarms);
+        while(g_hash_table_iter_next(&iter, &key, NULL))
+            alarm_list_window_alarm_update(applet->list_window, ALARM(key));
     }
 
     // Update Settings
     /*if (applet->settings_dialog && applet->settings_dialog->alarm == alarm) {
         g_debug ("TODO: Update settings dialog");
     }*/
+
+    g_hash_table_remove_all(applet->changed_alarms);
+
+    return G_SOURCE_REMOVE;
 }
 
 /**
- * Alarm 'alarm' signal handler
+ * Alarm changed signal handler
  *
- * Here we update any actions/views, if necessary
+ * A single edit usually sets several properties, so the alarm is only
+ * noted here and the UI is updated once from an idle. It runs ahead of
+ * redrawing, so the change still shows up in the next frame.
+ */
+void alarm_applet_alarm_changed(GObject* object, GParamSpec* pspec, gpointer data)
+{
+    AlarmApplet* applet = (AlarmApplet*)data;
+    Alarm* alarm = ALARM(object);
+
+    if(g_strcmp0(pspec->name, "active") == 0)
+        applet->changed_active = TRUE;
+
+    if(!applet->changed_alarms)
+        applet->changed_alarms = g_hash_table_new(NULL, NULL);
+
+    g_hash_table_add(applet->changed_alarms, alarm);
+
+    if(!applet->changed_id)
+        applet->changed_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, alarm_applet_alarms_changed_idle, applet, NULL);
+}
+
+/* Number of alarm messages listed in a notification */
+#define NOTIFICATION_MAX_ALARMS 5
+
+/*
+ * Notification body listing the messages of the alarms, followed by
+ * the given sentence
  */
-void alarm_applet_alarm_triggered(Alarm* alarm, gpointer data)
+static gchar* alarm_applet_notification_body(GPtrArray* alarms, const gchar* footer)
+{
+    GString* str = g_string_new(NULL);
+
+    for(guint i = 0; i < alarms->len && i < NOTIFICATION_MAX_ALARMS; i++)
+        g_string_append_printf(str, "%s\n", alarm_get_message(ALARM(g_ptr_array_index(alarms, i))));
+
+    if(alarms->len > NOTIFICATION_MAX_ALARMS) {
+        const guint n_more = alarms->len - NOTIFICATION_MAX_ALARMS;
+        g_string_append_printf(str, ngettext("And %u more.\n", "And %u more.\n", n_more), n_more);
+    }
+
+    g_string_append(str, footer);
+
+    return g_string_free(str, FALSE);
+}
+
+/**
+ * Alarms triggered handler
+ *
+ * Called once for all alarms that triggered together, so that a batch
+ * shows one notification and updates the actions once. Alarms missed
+ * while the applet wasn't running are summarized as such.
+ */
+void alarm_applet_alarms_triggered(GPtrArray* alarms, const guint* counts, gboolean missed, gpointer data)
 {
     AlarmApplet* applet = (AlarmApplet*)data;
     gchar *summary, *body;
-    const gchar* icon;
+    const gchar* icon = TIMER_ICON;
+    guint n_occurrences = 0;
 
-    g_debug("AlarmApplet: Alarm '%s' triggered", alarm->message);
+    g_debug("AlarmApplet: %u alarms triggered", alarms->len);
 
     // Keep track of how many alarms have been triggered
-    applet->n_triggered++;
+    applet->n_triggered += alarms->len;
+
+    for(guint i = 0; i < alarms->len; i++) {
+        if(ALARM(g_ptr_array_index(alarms, i))->type != ALARM_TYPE_TIMER)
+            icon = ALARM_ICON;
+
+        n_occurrences += counts ? counts[i] : 1;
+    }
 
     // Show notification
-    summary = g_strdup_printf("%s", alarm->message);
-    body = g_strdup_printf(_("You can snooze or stop alarms from the Alarm Clock menu."));
-    icon = (alarm->type == ALARM_TYPE_TIMER) ? TIMER_ICON : ALARM_ICON;
+    if(missed) {
+        summary = g_strdup_printf(ngettext("Missed %u alarm", "Missed %u alarms", n_occurrences), n_occurrences);
+        body = alarm_applet_notification_body(alarms, ngettext("This went off while Alarm Clock was not running.",
+                                                               "These went off while Alarm Clock was not running.", alarms->len));
+    } else if(alarms->len == 1) {
+        summary = g_strdup_printf("%s", alarm_get_message(ALARM(g_ptr_array_index(alarms, 0))));
+        body = g_strdup_printf(_("You can snooze or stop alarms from the Alarm Clock menu."));
+    } else {
+        summary = g_strdup_printf(ngettext("%u alarm", "%u alarms", alarms->len), alarms->len);
+        body = alarm_applet_notification_body(alarms, _("You can snooze or stop alarms from the Alarm Clock menu."));
+    }
+
     alarm_applet_notification_show(applet, summary, body, icon);
 
     g_free(summary);
@@ -408,7 +471,7 @@ void alarm_applet_alarm_cleared(Alarm* alarm, gpointer data)
 {
     AlarmApplet* applet = (AlarmApplet*)data;
 
-    g_debug("AlarmApplet: Alarm '%s' cleared", alarm->message);
+    g_debug("AlarmApplet: Alarm '%s' cleared", alarm_get_message(alarm));
 
     // Keep track of how many alarms have been triggered
     applet->n_triggered--;
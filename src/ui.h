@@ -34,7 +34,7 @@ GtkBuilder* alarm_applet_ui_load(const char* name, AlarmApplet* applet);
 
 void alarm_applet_alarm_changed(GObject* object, GParamSpec* pspec, gpointer data);
 
-void alarm_applet_alarm_triggered(Alarm* alarm, gpointer data);
+void alarm_applet_alarms_triggered(GPtrArray* alarms, const guint* counts, gboolean missed, gpointer data);
 
 void alarm_applet_alarm_cleared(Alarm* alarm, gpointer data);
 
@@ -11,45 +11,28 @@
 #include <glib.h>
 #include <glib-object.h>
 #include "util.h"
+#include "alarm-timezone.h"
 
 /**
  * Calculates the alarm timestamp given hour, min and secs.
  */
 time_t get_alarm_timestamp(guint hour, guint minute, guint second)
 {
-    time_t now;
-    struct tm tm;
-
-    time(&now);
-    tzset();
-    if(!localtime_r(&now, &tm)) {
-        memset(&tm, 0, sizeof(tm));
-        g_critical("get_alarm_timestamp: localtime failed");
-    }
+    const gint64 day = 24 * 60 * 60;
+    const gint64 now = alarm_timezone_to_local(time(NULL));
+    gint64 local = now - now % day + hour * 60 * 60 + minute * 60 + second;
 
     // Check if the alarm is for tomorrow
-    if(hour < tm.tm_hour || (hour == tm.tm_hour && minute < tm.tm_min) || (hour == tm.tm_hour && minute == tm.tm_min && second < tm.tm_sec)) {
+    if(local < now) {
         g_debug("Alarm is for tomorrow.");
-        tm.tm_mday++;
+        local += day;
     }
 
-    tm.tm_hour = hour;
-    tm.tm_min = minute;
-    tm.tm_sec = second;
-
-    // DEBUG:
-    char tmp[512];
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-y2k"
-#endif
-    strftime(tmp, sizeof(tmp), "%c", &tm);
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-    g_debug("Alarm will trigger at %s", tmp);
-
-    return mktime(&tm);
+    const gint64 ret = alarm_timezone_from_local(local);
+
+    g_debug("Alarm will trigger at %" G_GINT64_FORMAT, ret);
+
+    return ret;
 }
 
 /**